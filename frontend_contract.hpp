@@ -12,6 +12,9 @@ namespace scripted::ui {
 // Row to display
 struct Row { long long reg{}, addr{}; std::string val; };
 
+// A cell that references another one (see IView::showRefs)
+struct RefRow { long long bank{}, reg{}, addr{}; };
+
 struct ViewModel {
     std::optional<long long> current;
     std::vector<Row> rows;         // full set
@@ -45,6 +48,7 @@ struct IView {
 	std::function<void(long long,long long,const std::string&)> onRunCode; // reg, addr, stdin.json
 	std::function<void(long long,long long)>                   onDocCheck; // reg, addr
     std::function<void(long long,long long)>                       onDelete;
+    std::function<void(long long,long long)>                       onRefs;   // reg,addr: who references it
     std::function<void(const std::string&)> onFilter;   // filter changed
 	
 	// --- Add a non-disruptive display hook (Presenter -> View):
@@ -53,6 +57,12 @@ struct IView {
 								const std::string& stderr_text,
 								int exit_code,
 								const std::filesystem::path& workdir) = 0;
+
+	// Answer to onRefs; views without a dedicated panel get a status line.
+	virtual void showRefs(long long reg, long long addr, const std::vector<RefRow>& users) {
+		(void)reg; (void)addr;
+		showStatus(std::to_string(users.size()) + " reference(s)");
+	}
 };
 
 } // namespace scripted::ui
@@ -28,6 +28,7 @@ private:
     std::optional<long long> current;
     bool dirty=false;
     std::atomic<bool> busy{false};
+    bool rowsStale=false;  // a filter change waiting for a job to finish
 
     void wire(){
         view.onPreload = [this](){ preload(); };
@@ -37,7 +38,8 @@ private:
         view.onExport  = [this](){ exportAsync(); };
         view.onInsert  = [this](long long r,long long a,const std::string& v){ insert(r,a,v); };
         view.onDelete  = [this](long long r,long long a){ erase(r,a); };
-        view.onFilter  = [this](const std::string& f){ filter = f; refreshRows(); };
+        view.onRefs    = [this](long long r,long long a){ findRefs(r,a); };
+        view.onFilter  = [this](const std::string& f){ filter = f; if (busy) rowsStale=true; else refreshRows(); };
 		view.onRunCode = [this](long long r, long long a, const std::string& in){ runCodeAsync(r,a,in); };
 		view.onDocCheck = [this](long long r, long long a){ docCheckAsync(r,a); };
 
@@ -45,7 +47,23 @@ private:
 
     std::string filter;
 
+    // Background jobs resolve against ws itself (filling its cache and
+    // indexes, loading referenced banks) without a lock, so nothing on the
+    // UI thread touches ws until they finish.
+    bool idle(){
+        if (!busy) return true;
+        view.showStatus("Busy...");
+        return false;
+    }
+    // On the UI thread, when a background job ends.
+    void jobDone(){
+        view.setBusy(false);
+        busy=false;
+        if (rowsStale){ rowsStale=false; refreshRows(); }
+    }
+
     void preload(){
+        if (!idle()) return;
         preloadAll(cfg, ws);
         pushBanks();
         view.showStatus("Preloaded "+std::to_string(ws.banks.size())+" banks.");
@@ -61,6 +79,7 @@ private:
     }
 
     void openOrSwitch(const std::string& nameOrStem){
+        if (!idle()) return;
         std::string status;
         if (!::scripted::openCtx(cfg, ws, nameOrStem, status)){
             view.showStatus(status);
@@ -81,8 +100,8 @@ private:
         if (current){
             auto& b = ws.banks[*current];
             for (auto& [rid, addrs] : b.regs)
-                for (auto& [aid, val] : addrs)
-                    rows.push_back({rid, aid, val});
+                for (const auto& [aid, val] : addrs)
+                    rows.push_back({rid, aid, std::string(val)});
             if (!filter.empty()){
                 auto f = filter; std::transform(f.begin(), f.end(), f.begin(), ::tolower);
                 std::vector<Row> out; out.reserve(rows.size());
@@ -90,10 +109,12 @@ private:
                     std::string h=s; std::transform(h.begin(), h.end(), h.begin(), ::tolower);
                     return h.find(f)!=std::string::npos;
                 };
-                for (auto& r: rows){
-                    if (contains(toBaseN(r.reg,cfg.base,cfg.widthReg)) ||
-                        contains(toBaseN(r.addr,cfg.base,cfg.widthAddr)) ||
-                        contains(r.val)) out.push_back(r);
+                auto regs  = formatIdColumn(rows, [](const Row& r){ return r.reg; },  cfg.base, cfg.widthReg);
+                auto addrs = formatIdColumn(rows, [](const Row& r){ return r.addr; }, cfg.base, cfg.widthAddr);
+                for (size_t i=0; i<rows.size(); ++i){
+                    if (regs[i].find(f)!=std::string_view::npos ||
+                        addrs[i].find(f)!=std::string_view::npos ||
+                        contains(rows[i].val)) out.push_back(rows[i]);
                 }
                 rows.swap(out);
             }
@@ -104,25 +125,33 @@ private:
 
     void insert(long long reg, long long addr, const std::string& val){
         if (!current){ view.showStatus("No current context"); return; }
-        ws.banks[*current].regs[reg][addr] = val; dirty=true;
+        if (!idle()) return;
+        setCell(cfg, ws, *current, reg, addr, val); dirty=true;
         refreshRows();
         view.showStatus("Updated "+toBaseN(reg,cfg.base,cfg.widthReg)+"."+toBaseN(addr,cfg.base,cfg.widthAddr));
     }
 
     void erase(long long reg, long long addr){
         if (!current){ view.showStatus("No current context"); return; }
-        auto& regs = ws.banks[*current].regs;
-        auto itR = regs.find(reg);
-        if (itR!=regs.end()){
-            if (itR->second.erase(addr)) { dirty=true; refreshRows(); view.showStatus("Deleted."); }
-        }
+        if (!idle()) return;
+        if (eraseCell(cfg, ws, *current, reg, addr)) { dirty=true; refreshRows(); view.showStatus("Deleted."); }
+    }
+
+    void findRefs(long long reg, long long addr){
+        if (!current){ view.showStatus("No current context"); return; }
+        if (!idle()) return;
+        std::vector<RefRow> users;
+        for (auto& k : findReferences(cfg, ws, *current, reg, addr))
+            users.push_back({k.bank, k.reg, k.addr});
+        view.showRefs(reg, addr, users);
     }
 
     void save(){
         if (!current){ view.showStatus("No current context"); return; }
+        if (!idle()) return;
         std::string err;
         auto path = contextFileName(cfg, *current);
-        if (!saveContextFile(cfg, path, ws.banks[*current], err)){
+        if (!saveWorkspaceBank(cfg, ws, *current, err)){
             view.showStatus("Save failed: "+err);
             return;
         }
@@ -138,14 +167,13 @@ private:
         std::thread([this,id](){
             std::string path; bool ok=true;
             try {
-                auto txt = resolveBankToText(cfg, ws, id);
+                auto txt = resolveBankToText(cfg, ws, id, defaultJobs());
                 auto outp = outResolvedName(cfg, id);
                 std::ofstream out(outp, std::ios::binary); out<<txt;
                 path = outp.string();
             } catch(...) { ok=false; }
             view.postToUi([this,ok,path](){
-                view.setBusy(false);
-                busy=false;
+                jobDone();
                 view.showStatus(ok? "Resolved -> "+path : "Resolve failed.");
             });
         }).detach();
@@ -159,14 +187,13 @@ private:
         std::thread([this,id](){
             std::string path; bool ok=true;
             try {
-                auto js = exportBankToJSON(cfg, ws, id);
+                auto js = exportBankToJSON(cfg, ws, id, defaultJobs());
                 auto outp = outJsonName(cfg, id);
                 std::ofstream out(outp, std::ios::binary); out<<js;
                 path = outp.string();
             } catch(...) { ok=false; }
             view.postToUi([this,ok,path](){
-                view.setBusy(false);
-                busy=false;
+                jobDone();
                 view.showStatus(ok? "Exported JSON -> "+path : "Export failed.");
             });
         }).detach();
@@ -189,9 +216,8 @@ private:
 				auto &b = ws.banks[id];
 				auto itR = b.regs.find(reg);
 				if (itR==b.regs.end() || !itR->second.count(addr)) throw std::runtime_error("No such cell.");
-				std::unordered_set<std::string> visited;
 				Resolver R(cfg, ws);
-				std::string expanded = R.resolve(itR->second[addr], id, visited);
+				std::string expanded = R.resolve(*itR->second.find(addr), id);
 
 				// 2) Build & run
 				scripted_exec::ExecManager EM;   // files/out/exec/...
@@ -203,7 +229,7 @@ private:
 			}
 
 			view.postToUi([this,ok,status,out,err,exitc,workdir](){
-				view.setBusy(false); busy=false;
+				jobDone();
 				view.showStatus(ok ? ("Run OK: " + status) : ("Run failed: " + status));
 				view.showExecResult("In‑world exec", out, err, exitc, workdir);
 			});
@@ -225,9 +251,8 @@ private:
 				auto itR = b.regs.find(reg);
 				if (itR==b.regs.end() || !itR->second.count(addr)) throw std::runtime_error("No such cell.");
 
-				std::unordered_set<std::string> visited;
 				Resolver R(cfg, ws);
-				std::string expanded = R.resolve(itR->second[addr], id, visited);
+				std::string expanded = R.resolve(*itR->second.find(addr), id);
 
 				auto doc = scripted_exec::extract_doc_block(expanded);
 				if (!doc) throw std::runtime_error("Missing /*---DOC--- ... ---END---*/");
@@ -237,7 +262,7 @@ private:
 			}
 
 			view.postToUi([this,ok,report](){
-				view.setBusy(false); busy=false;
+				jobDone();
 				view.showExecResult("Doc check", ok? report : std::string("ERROR: ")+report, "", ok?0:1, {});
 			});
 		}).detach();
@@ -48,6 +48,7 @@ using namespace scripted;
 using namespace scripted::ui;
 
 static QString qFromStd(const std::string& s){ return QString::fromUtf8(s.c_str()); }
+static QString qFromId(std::string_view s){ return QString::fromLatin1(s.data(), (qsizetype)s.size()); }
 static std::string qToStd(const QString& s){ QByteArray b = s.toUtf8(); return std::string(b.constData(), (size_t)b.size()); }
 
 class QtView final : public QMainWindow, public IView {
@@ -84,11 +85,12 @@ public:
             model->setHeaderData(2, Qt::Horizontal, "Value (raw)");
         }
         model->setRowCount((int)rows.size());
+        auto regs  = formatIdColumn(rows, [](const Row& r){ return r.reg; },  cfg.base, cfg.widthReg);
+        auto addrs = formatIdColumn(rows, [](const Row& r){ return r.addr; }, cfg.base, cfg.widthAddr);
         for (int i=0;i<(int)rows.size();++i){
-            const Row& r = rows[i];
-            model->setData(model->index(i,0), qFromStd(toBaseN(r.reg,  cfg.base, cfg.widthReg)));
-            model->setData(model->index(i,1), qFromStd(toBaseN(r.addr, cfg.base, cfg.widthAddr)));
-            model->setData(model->index(i,2), qFromStd(r.val));
+            model->setData(model->index(i,0), qFromId(regs[i]));
+            model->setData(model->index(i,1), qFromId(addrs[i]));
+            model->setData(model->index(i,2), qFromStd(rows[i].val));
         }
         table->resizeColumnsToContents();
     }
@@ -125,6 +127,15 @@ public:
 	}
 
 
+    void showRefs(long long reg, long long addr, const std::vector<RefRow>& users) override {
+        std::string msg = std::to_string(users.size()) + " reference(s) to "
+                        + toBaseN(reg, cfg.base, cfg.widthReg) + "." + toBaseN(addr, cfg.base, cfg.widthAddr);
+        for (auto& u : users)
+            msg += "\n  " + displayKey(u.bank) + "  " + toBaseN(u.reg, cfg.base, cfg.widthReg)
+                 + "." + toBaseN(u.addr, cfg.base, cfg.widthAddr);
+        showStatus(msg);
+    }
+
     void setBusy(bool on) override {
         progress->setVisible(on);
         progress->setRange(0, on ? 0 : 1); // 0..0 => busy indicator (Qt)
@@ -170,6 +181,10 @@ private:
         actCopy->setShortcut(QKeySequence::Copy);
         connect(actCopy, &QAction::triggered, this, [this]{ copySelection(); });
 
+        auto actRefs = edit->addAction("Find &references\tCtrl+Shift+R");
+        actRefs->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_R));
+        connect(actRefs, &QAction::triggered, this, [this]{ refsSelected(); });
+
         auto view = mbar->addMenu("&View");
         auto actPreload = view->addAction("&Preload banks\tF5");
         actPreload->setShortcut(QKeySequence(Qt::Key_F5));
@@ -432,6 +447,19 @@ private:
 	}
 
 
+	void refsSelected(){
+		if (!onRefs) return;
+		auto sel = table->selectionModel()->selectedRows();
+		if (sel.isEmpty()){ showStatus("Select a row first."); return; }
+		const int row = sel.first().row();
+		long long r=0,a=0;
+		if (!parseIntBase(qToStd(model->index(row,0).data().toString()), cfg.base, r) ||
+			!parseIntBase(qToStd(model->index(row,1).data().toString()), cfg.base, a)) {
+			showStatus("Bad reg/addr"); return;
+		}
+		onRefs(r, a);
+	}
+
     std::string displayKey(long long id) const {
         return std::string(1, cfg.prefix) + toBaseN(id, cfg.base, cfg.widthBank);
     }
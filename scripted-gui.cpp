@@ -413,8 +413,8 @@ struct App {
         if (!current) return;
         auto& b = ws.banks[*current];
         for (auto& [rid, addrs] : b.regs){
-            for (auto& [aid, val] : addrs){
-                rows.push_back({rid, aid, val});
+            for (const auto& [aid, val] : addrs){
+                rows.push_back({rid, aid, std::string(val)});
             }
         }
         visibleIndex.resize((int)rows.size());
@@ -431,16 +431,17 @@ struct App {
             visibleIndex.resize((int)rows.size());
             for (int i=0;i<(int)rows.size();++i) visibleIndex[i]=i;
         } else {
+            auto regs  = formatIdColumn(rows, [](const Row& r){ return r.reg; },  cfg.base, cfg.widthReg);
+            auto addrs = formatIdColumn(rows, [](const Row& r){ return r.addr; }, cfg.base, cfg.widthAddr);
+            auto contains=[&](const std::string& hay){
+                std::string h = hay; std::transform(h.begin(), h.end(), h.begin(), ::tolower);
+                return h.find(fLower)!=std::string::npos;
+            };
             for (int i=0;i<(int)rows.size(); ++i){
-                auto& r = rows[i];
-                std::string regS = toBaseN(r.reg, cfg.base, cfg.widthReg);
-                std::string addrS= toBaseN(r.addr,cfg.base, cfg.widthAddr);
-                std::string valS = r.val;
-                auto contains=[&](const std::string& hay){
-                    std::string h = hay; std::transform(h.begin(), h.end(), h.begin(), ::tolower);
-                    return h.find(fLower)!=std::string::npos;
-                };
-                if (contains(regS) || contains(addrS) || contains(valS))
+                // ids are already lowercase
+                if (regs[i].find(fLower)!=std::string_view::npos ||
+                    addrs[i].find(fLower)!=std::string_view::npos ||
+                    contains(rows[i].val))
                     visibleIndex.push_back(i);
             }
         }
@@ -467,7 +468,7 @@ struct App {
 		std::string err;
 		auto path = contextFileName(cfg, *current);
 
-		if (!::scripted::saveContextFile(cfg, path, ws.banks[*current], err)) {
+		if (!::scripted::saveWorkspaceBank(cfg, ws, *current, err)) {
 			if (err.find("denied") != std::string::npos || err.find("permission") != std::string::npos)
 				err += " — check folder permissions or choose a writable location.";
 			setStatus("Save failed: " + err);
@@ -507,7 +508,7 @@ struct App {
         if (!parseIntBase(trim(regS), cfg.base, regId)){ setStatus("Bad reg"); return; }
         if (!parseIntBase(trim(addrS), cfg.base, addrId)){ setStatus("Bad addr"); return; }
 
-        ws.banks[*current].regs[regId][addrId] = valS; dirty=true;
+        setCell(cfg, ws, *current, regId, addrId, valS); dirty=true;
 
         bool found=false;
         for (auto& r : rows){ if (r.reg==regId && r.addr==addrId){ r.val = valS; found=true; break; } }
@@ -524,18 +525,13 @@ struct App {
         if (iSel<0) return;
         if (iSel >= (int)visibleIndex.size()) return;
         Row r = rows[visibleIndex[iSel]];
-        auto& regs = ws.banks[*current].regs;
-        auto itR = regs.find(r.reg);
-        if (itR!=regs.end()){
-            size_t n = itR->second.erase(r.addr);
-            if (n>0){
-                dirty=true;
-                for (size_t i=0;i<rows.size();++i){
-                    if (rows[i].reg==r.reg && rows[i].addr==r.addr){ rows.erase(rows.begin()+i); break; }
-                }
-                applyFilter(); refreshList();
-                setStatus("Deleted.");
+        if (eraseCell(cfg, ws, *current, r.reg, r.addr)){
+            dirty=true;
+            for (size_t i=0;i<rows.size();++i){
+                if (rows[i].reg==r.reg && rows[i].addr==r.addr){ rows.erase(rows.begin()+i); break; }
             }
+            applyFilter(); refreshList();
+            setStatus("Deleted.");
         }
     }
 
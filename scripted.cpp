@@ -1,5 +1,5 @@
 // scripted.cpp — CLI REPL using shared core (now with :insr and :delr)
-// g++ -std=c++23 -O2 scripted.cpp -o scripted.exe
+// g++ -std=c++23 -O2 -pthread scripted.cpp -o scripted.exe
 #include "scripted_core.hpp"
 #include "scripted_exec.hpp"   // <— ADD THIS
 #include <iostream>
@@ -24,7 +24,7 @@ R"(Commands:
   :help                          Show this help
   :open <ctx>                    Open/create context (e.g., x00001)
   :switch <ctx>                  Switch current context
-  :preload                       Load all banks in files/
+  :preload [--frozen]            Load all banks in files/ (--frozen: packed read-only until edited)
   :ls                            List loaded contexts
   :show                          Print current buffer (header + addresses)
   :ins <addr> <value...>         Insert/replace in register 1
@@ -33,11 +33,24 @@ R"(Commands:
   :delr <reg> <addr>             Delete from a specific register
   :w                             Write current buffer to files/<ctx>.txt
   :r <path>                      Read/merge a raw model snippet from a file
-  :resolve                       Write files/out/<ctx>.resolved.txt
-  :export                        Write files/out/<ctx>.json
+  :refs <reg> <addr>             List loaded cells that reference this cell
+  :cycles                        List reference cycles among loaded banks
+  :stats                         Cell value bytes of loaded banks and how much interning saves
+  :bankc [all]                   Compile current (or every) bank to files/<ctx>.bankc
+  :bankc_text [ctx]              Write files/out/<ctx>.txt back from its .bankc
+  :bankc_status                  Show whether each .bankc is current, stale or missing
+  :bench [path]                  Scan/parse GB/s per SIMD kernel (scalar, sse2, avx2)
+  :resolve [-j N]                Write files/out/<ctx>.resolved.txt (N threads; 0 = all cores)
+  :export [-j N]                 Write files/out/<ctx>.json
+  :resolve --stream [ctx]        :resolve straight from files/<ctx>.txt without loading it
+  :export --stream [ctx]         :export straight from files/<ctx>.txt without loading it
+  :resolve_all [-j N]            :resolve every loaded and on-disk bank (pipelined)
+  :export_all [-j N]             :export every loaded and on-disk bank (pipelined)
   :set prefix <char>
   :set base <n>
   :set widths bank=5 addr=4 reg=2
+  :set journal on|off            Log each edit to files/<ctx>.wal as it is made
+  :compact                       Fold the current journal into files/<ctx>.txt
   :run_code						 Run Java, C, C++, Python
   :q                             Quit (prompts if dirty)
 )" << std::endl;
@@ -47,7 +60,7 @@ R"(Commands:
         if (ws.banks.empty()) { std::cout<<"(no contexts)\n"; return; }
         for (auto& [id,b] : ws.banks){
             std::cout<<cfg.prefix<<toBaseN(id,cfg.base,cfg.widthBank)<<"  ("<<b.title<<")"
-                     <<(current && *current==id? " [current]":"")<<"\n";
+                     <<(b.frozen()? " [frozen]":"")<<(current && *current==id? " [current]":"")<<"\n";
         }
     }
 
@@ -59,16 +72,49 @@ R"(Commands:
     void write(){
         if (!ensureCurrent()) return;
         string err;
-        if (!saveContextFile(cfg, contextFileName(cfg, *current), ws.banks[*current], err))
+        if (!saveWorkspaceBank(cfg, ws, *current, err))
             std::cout<<"Write failed: "<<err<<"\n";
         else { dirty=false; std::cout<<"Saved "<<contextFileName(cfg,*current).string()<<"\n"; }
     }
 
+    void stats(){
+        ValueStats st = valueStats(ws);
+        std::cout<<ws.banks.size()<<" banks, "<<st.cells<<" cells, "<<st.bytes/1024<<" KiB of values stored as "
+                 <<st.distinct<<" distinct ("<<st.stored/1024<<" KiB): dedup "<<st.dedup()<<"x; "
+                 <<st.reserved/1024<<" KiB in value arenas\n";
+    }
+
+    void compact(){
+        if (!ensureCurrent()) return;
+        Journal* j = journalFor(cfg, ws, *current);
+        if (!j){ std::cout<<"No journal (:set journal on).\n"; return; }
+        j->wait();
+        const unsigned long long n = j->pending();
+        string err;
+        if (!j->compact(cfg, err)) std::cout<<"Compact failed: "<<err<<"\n";
+        else std::cout<<"Folded "<<n<<" journal bytes into "<<contextFileName(cfg,*current).string()<<"\n";
+    }
+
+    // Journals are named after the bank file, and are not replayed with
+    // journaling off: closing them for a :set that renames or disables
+    // them leaves what they hold unsaved.
+    void closeJournals(){
+        for (auto& [id, j] : ws.journals){ j->wait(); if (j->pending()) dirty=true; }
+        ws.journals.clear();
+    }
+
+    // dirty: edits that are neither saved nor journaled.
+    void edited(bool journaled){
+        if (journaled) return;
+        dirty=true;
+        if (cfg.journal) std::cout<<"Journal write failed; unsaved until :w.\n";
+    }
+
     void insert(const string& addrTok, const string& value){
         if (!ensureCurrent()) return;
         long long addr;
         if (!parseIntBase(addrTok, cfg.base, addr)) { std::cout<<"Bad address\n"; return; }
-        ws.banks[*current].regs[1][addr] = value; dirty=true;
+        bool journaled; setCell(cfg, ws, *current, 1, addr, value, &journaled); edited(journaled);
     }
 
     void insertR(const string& regTok, const string& addrTok, const string& value){
@@ -76,16 +122,15 @@ R"(Commands:
         long long reg=1, addr=0;
         if (!parseIntBase(regTok, cfg.base, reg))  { std::cout<<"Bad register\n"; return; }
         if (!parseIntBase(addrTok, cfg.base, addr)){ std::cout<<"Bad address\n";  return; }
-        ws.banks[*current].regs[reg][addr] = value; dirty=true;
+        bool journaled; setCell(cfg, ws, *current, reg, addr, value, &journaled); edited(journaled);
     }
 
     void del(const string& addrTok){
         if (!ensureCurrent()) return;
         long long addr; if (!parseIntBase(addrTok, cfg.base, addr)) { std::cout<<"Bad address\n"; return; }
-        auto& m = ws.banks[*current].regs[1];
-        size_t n = m.erase(addr);
+        bool journaled; bool n = eraseCell(cfg, ws, *current, 1, addr, &journaled);
         std::cout<<(n? "Deleted.\n":"No such address.\n");
-        if (n) dirty=true;
+        if (n) edited(journaled);
     }
 
     void delR(const string& regTok, const string& addrTok){
@@ -93,46 +138,185 @@ R"(Commands:
         long long reg=1, addr=0;
         if (!parseIntBase(regTok, cfg.base, reg))  { std::cout<<"Bad register\n"; return; }
         if (!parseIntBase(addrTok, cfg.base, addr)){ std::cout<<"Bad address\n";  return; }
-        auto& regs = ws.banks[*current].regs;
-        auto itR = regs.find(reg);
-        if (itR==regs.end()){ std::cout<<"No such register.\n"; return; }
-        size_t n = itR->second.erase(addr);
+        auto& b = ws.banks[*current];
+        auto itR = b.regs.find(reg);
+        if (itR==b.regs.end()){ std::cout<<"No such register.\n"; return; }
+        bool journaled; bool n = eraseCell(cfg, ws, *current, reg, addr, &journaled);
         std::cout<<(n? "Deleted.\n":"No such address.\n");
-        if (n) dirty=true;
-        if (itR->second.empty()) regs.erase(itR); // tidy up empty register
+        if (n) edited(journaled);
+        if (itR->second.empty()) b.regs.erase(itR); // tidy up empty register
     }
 
+    // Streamed twice: once to validate, so a bad file merges nothing, then
+    // to merge; the snippet itself is never held in memory.
     void readMerge(const string& path){
         if (!ensureCurrent()) return;
-        std::ifstream in(path, std::ios::binary);
-        if (!in){ std::cout<<"Cannot open "<<path<<"\n"; return; }
-        string text( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
-        Bank tmp;
-        auto pr = parseBankText(text, cfg, tmp);
-        if (!pr.ok){ std::cout<<"Parse failed: "<<pr.err<<"\n"; return; }
-        for (auto& [rid, addrs] : tmp.regs)
-            for (auto& [aid, val] : addrs)
-                ws.banks[*current].regs[rid][aid] = val;
-        if (ws.banks[*current].title.empty()) ws.banks[*current].title = tmp.title;
-        dirty=true; std::cout<<"Merged.\n";
-    }
-
-    void resolveOut(){
+        BankStream::Record r;
+        {
+            BankStream check(path, cfg);
+            while (check.next(r)) {}
+            if (!check.result().ok){
+                if (!check.ok() && check.result().err.rfind("cannot open", 0)==0) std::cout<<"Cannot open "<<path<<"\n";
+                else std::cout<<"Parse failed: "<<check.result().err<<"\n";
+                return;
+            }
+        }
+        BankStream in(path, cfg);
+        const bool journaled = setCells(cfg, ws, *current, in);
+        if (ws.banks[*current].title.empty()){ ws.banks[*current].title = in.title(); dirty=true; }
+        edited(journaled); std::cout<<"Merged.\n";
+    }
+
+    void refs(const string& regTok, const string& addrTok){
+        if (!ensureCurrent()) return;
+        long long reg=1, addr=0;
+        if (!parseIntBase(regTok, cfg.base, reg))  { std::cout<<"Bad register\n"; return; }
+        if (!parseIntBase(addrTok, cfg.base, addr)){ std::cout<<"Bad address\n";  return; }
+        auto users = findReferences(cfg, ws, *current, reg, addr);
+        for (auto& k : users){
+            std::cout<<cfg.prefix<<toBaseN(k.bank,cfg.base,cfg.widthBank)<<"  "
+                     <<toBaseN(k.reg,cfg.base,cfg.widthReg)<<"."<<toBaseN(k.addr,cfg.base,cfg.widthAddr)<<"\n";
+        }
+        std::cout<<users.size()<<" reference(s) across "<<ws.banks.size()<<" loaded bank(s).\n";
+    }
+
+    void cycles(){
+        auto& ci = analyzeCycles(cfg, ws);
+        size_t n = 0;
+        for (auto& comp : ci.components){
+            std::cout<<"cycle "<<++n<<":";
+            for (auto& k : comp)
+                std::cout<<"  "<<cfg.prefix<<toBaseN(k.bank,cfg.base,cfg.widthBank)<<" "
+                         <<toBaseN(k.reg,cfg.base,cfg.widthReg)<<"."<<toBaseN(k.addr,cfg.base,cfg.widthAddr);
+            std::cout<<"\n";
+        }
+        std::cout<<ci.cyclic.size()<<" cell(s) on "<<ci.components.size()<<" cycle(s) across "
+                 <<ws.banks.size()<<" loaded bank(s).\n";
+    }
+
+    // "-j N" / "-jN" among the arguments; 1 when absent, 0 means all cores.
+    static unsigned jobsArg(const std::vector<string>& tok){
+        for (size_t i=1; i<tok.size(); ++i){
+            string n;
+            if (tok[i]=="-j" && i+1<tok.size()) n = tok[i+1];
+            else if (tok[i].rfind("-j", 0)==0 && tok[i].size()>2) n = tok[i].substr(2);
+            else continue;
+            long long v=0;
+            if (!parseIntBase(n, 10, v)) return 1;
+            return v<=0 ? defaultJobs() : (unsigned)std::min<long long>(v, 1024);
+        }
+        return 1;
+    }
+
+    void resolveOut(unsigned jobs=1){
         if (!ensureCurrent()) return;
-        auto txt = resolveBankToText(cfg, ws, *current);
+        auto txt = resolveBankToText(cfg, ws, *current, jobs);
         auto outp = outResolvedName(cfg, *current);
         std::ofstream out(outp, std::ios::binary); out<<txt;
         std::cout<<"Wrote "<<outp<<"\n";
     }
 
-    void exportJson(){
+    void exportJson(unsigned jobs=1){
         if (!ensureCurrent()) return;
-        auto js = exportBankToJSON(cfg, ws, *current);
+        auto js = exportBankToJSON(cfg, ws, *current, jobs);
         auto outp = outJsonName(cfg, *current);
         std::ofstream out(outp, std::ios::binary); out<<js;
         std::cout<<"Wrote "<<outp<<"\n";
     }
 
+    // :resolve/:export --stream [ctx] — resolve files/<ctx>.txt straight from
+    // disk without loading it, for banks larger than memory.
+    void streamOut(const std::vector<string>& tok, bool json){
+        long long id;
+        string name;
+        for (size_t i=1; i<tok.size(); ++i) if (tok[i]!="--stream") name = tok[i];
+        if (!name.empty()){
+            string token = (name[0]==cfg.prefix)? name.substr(1): name;
+            if (!parseIntBase(token, cfg.base, id)){ std::cout<<"Bad id\n"; return; }
+        } else { if (!ensureCurrent()) return; id = *current; }
+        if (dirty && current && *current==id) std::cout<<"(streaming the saved file; unsaved edits are not included)\n";
+        auto outp = json ? outJsonName(cfg, id) : outResolvedName(cfg, id);
+        std::ofstream out(outp, std::ios::binary);
+        string err;
+        if (!streamResolveBankFile(cfg, ws, contextFileName(cfg, id), out, json, err)){ std::cout<<err<<"\n"; return; }
+        std::cout<<"Wrote "<<outp<<"\n";
+    }
+
+    void exportAll(bool json, unsigned jobs){
+        auto rep = exportAllBanks(cfg, ws, json, jobs);
+        for (auto& e : rep.errors) std::cout<<"  "<<e<<"\n";
+        std::cout<<"Wrote "<<rep.written<<" of "<<rep.banks<<" bank(s) to files/out/"
+                 <<(rep.errors.empty()? "" : " ("+std::to_string(rep.errors.size())+" error(s))")<<"\n";
+    }
+
+    // :bankc [all] — compile the current (or every on-disk) bank to files/<ctx>.bankc
+    void bankc(const std::vector<string>& tok){
+        std::vector<long long> ids;
+        if (tok.size()>=2 && tok[1]=="all") ids = bankIdsOnDisk(cfg);
+        else { if (!ensureCurrent()) return; ids.push_back(*current); }
+        size_t ok=0;
+        for (long long id : ids){
+            string err;
+            if (compileBankFile(cfg, id, err)){ ++ok; ws.compiled.erase(id); }
+            else std::cout<<"  "<<err<<"\n";
+        }
+        std::cout<<"Compiled "<<ok<<" of "<<ids.size()<<" bank(s).\n";
+    }
+
+    // :bankc_text [ctx] — write files/out/<ctx>.txt back from files/<ctx>.bankc
+    void bankcText(const std::vector<string>& tok){
+        long long id;
+        if (tok.size()>=2){
+            string name = tok[1]; if (name.size()>6 && name.ends_with(".bankc")) name = name.substr(0,name.size()-6);
+            string token = (name[0]==cfg.prefix)? name.substr(1): name;
+            if (!parseIntBase(token, cfg.base, id)){ std::cout<<"Bad id\n"; return; }
+        } else { if (!ensureCurrent()) return; id = *current; }
+        CompiledBank cb; string err;
+        if (!cb.open(compiledFileName(cfg, id), err)){ std::cout<<err<<"\n"; return; }
+        Bank b; cb.toBank(cfg, b);
+        auto outp = fs::path("files/out") / contextFileName(cfg, id).filename();
+        if (!saveContextFile(cfg, outp, b, err)){ std::cout<<err<<"\n"; return; }
+        std::cout<<"Wrote "<<outp<<" ("<<cb.size()<<" cells)\n";
+    }
+
+    // :bench [path] — scan/parse throughput per kernel over a bank file, or
+    // over a generated 32 MiB bank.
+    void bench(const std::vector<string>& tok){
+        MappedFile map;
+        string text;
+        std::string_view view;
+        if (tok.size()>=2){
+            string err;
+            if (!map.open(tok[1], err)){ std::cout<<err<<"\n"; return; }
+            view = map.view();
+        } else {
+            text = string(1,cfg.prefix) + toBaseN(1,cfg.base,cfg.widthBank) + "\t(Bench){\n";
+            for (long long r=1; text.size() < (32u<<20); ++r){
+                text += toBaseN(r,cfg.base,cfg.widthReg) + "\n";
+                for (long long a=0; a<1000; ++a){
+                    text += '\t';
+                    text += toBaseN(a,cfg.base,cfg.widthAddr);
+                    text += "\tsome value text ";
+                    text += std::to_string(a);
+                    text += '\n';
+                }
+            }
+            text += "}\n";
+            view = text;
+        }
+        std::cout<<"active: "<<scanKernelName(bestScanKernel())<<", "<<view.size()/1024<<" KiB\n";
+        for (auto& b : benchScanKernels(view, cfg)){
+            std::cout<<"  "<<scanKernelName(b.kernel)<<"\tscan "<<b.scanGBs<<" GB/s\tparse "<<b.parseGBs<<" GB/s\n";
+        }
+    }
+
+    void bankcStatus(){
+        auto ids = bankIdsOnDisk(cfg);
+        std::sort(ids.begin(), ids.end());
+        for (long long id : ids)
+            std::cout<<cfg.prefix<<toBaseN(id,cfg.base,cfg.widthBank)<<"  "<<compiledBankStatus(cfg, id)<<"\n";
+    }
+
     void repl(){
         P.ensure();
         loadConfig();
@@ -149,7 +333,10 @@ R"(Commands:
             if (s==":ls"){ listCtx(); continue; }
             if (s==":show"){ show(); continue; }
             if (s==":w"){ write(); continue; }
-            if (s==":preload"){ preloadAll(cfg, ws); std::cout<<"Preloaded "<<ws.banks.size()<<" banks.\n"; continue; }
+            if (s==":cycles"){ cycles(); continue; }
+            if (s==":compact"){ compact(); continue; }
+            if (s==":stats"){ stats(); continue; }
+            if (s==":bankc_status"){ bankcStatus(); continue; }
             if (s==":resolve"){ resolveOut(); continue; }
             if (s==":export"){ exportJson(); continue; }
             if (s==":q"){
@@ -184,13 +371,12 @@ R"(Commands:
 
 				auto itR = ws.banks[*current].regs.find(r);
 				if (itR == ws.banks[*current].regs.end()) { std::cout << "No such register\n"; continue; }
-				auto itA = itR->second.find(a);
-				if (itA == itR->second.end()) { std::cout << "No such address\n"; continue; }
+				const CellValue* cell = itR->second.find(a);
+				if (!cell) { std::cout << "No such address\n"; continue; }
 
 				// (Optional but recommended) resolve @file(...) and cross-bank refs before running:
-				std::unordered_set<std::string> visited;
 				Resolver R(cfg, ws);
-				std::string expanded = R.resolve(itA->second, *current, visited);
+				std::string expanded = R.resolve(*cell, *current);
 
 				scripted_exec::ExecManager EM; // out: files/out/exec/
 				std::string stdin_json = (tok.size() >= 4) ? tok[3] : std::string("{}");
@@ -220,10 +406,32 @@ R"(Commands:
             if (tok[0]==":del" && tok.size()>=2){ del(tok[1]); continue; }
             if (tok[0]==":delr" && tok.size()>=3){ delR(tok[1], tok[2]); continue; }
             if (tok[0]==":r" && tok.size()>=2){ readMerge(tok[1]); continue; }
+            if (tok[0]==":refs" && tok.size()>=3){ refs(tok[1], tok[2]); continue; }
+            if (tok[0]==":resolve"){
+                if (std::find(tok.begin(), tok.end(), "--stream")!=tok.end()) streamOut(tok, false);
+                else resolveOut(jobsArg(tok));
+                continue;
+            }
+            if (tok[0]==":export"){
+                if (std::find(tok.begin(), tok.end(), "--stream")!=tok.end()) streamOut(tok, true);
+                else exportJson(jobsArg(tok));
+                continue;
+            }
+            if (tok[0]==":preload"){
+                preloadAll(cfg, ws, std::find(tok.begin(), tok.end(), "--frozen")!=tok.end());
+                std::cout<<"Preloaded "<<ws.banks.size()<<" banks.\n";
+                continue;
+            }
+            if (tok[0]==":bankc"){ bankc(tok); continue; }
+            if (tok[0]==":bankc_text"){ bankcText(tok); continue; }
+            if (tok[0]==":bench"){ bench(tok); continue; }
+            if (tok[0]==":resolve_all"){ exportAll(false, jobsArg(tok)); continue; }
+            if (tok[0]==":export_all"){ exportAll(true, jobsArg(tok)); continue; }
             if (tok[0]==":set" && tok.size()>=2){
-                if (tok[1]=="prefix" && tok.size()>=3){ cfg.prefix = tok[2][0]; saveCfg(); std::cout<<"prefix="<<cfg.prefix<<"\n"; }
-                else if (tok[1]=="base" && tok.size()>=3){ int b=std::stoi(tok[2]); if (b<2||b>36) std::cout<<"base 2..36\n"; else { cfg.base=b; saveCfg(); std::cout<<"base="<<cfg.base<<"\n"; } }
+                if (tok[1]=="prefix" && tok.size()>=3){ closeJournals(); cfg.prefix = tok[2][0]; saveCfg(); std::cout<<"prefix="<<cfg.prefix<<"\n"; }
+                else if (tok[1]=="base" && tok.size()>=3){ int b=std::stoi(tok[2]); if (b<2||b>36) std::cout<<"base 2..36\n"; else { closeJournals(); cfg.base=b; saveCfg(); std::cout<<"base="<<cfg.base<<"\n"; } }
                 else if (tok[1]=="widths"){
+                    closeJournals();
                     for(size_t i=2;i<tok.size();++i){
                         auto p=tok[i].find('='); if(p==string::npos) continue;
                         auto k=tok[i].substr(0,p); auto v=tok[i].substr(p+1); int n=std::stoi(v);
@@ -231,6 +439,11 @@ R"(Commands:
                     }
                     saveCfg(); std::cout<<"widths bank="<<cfg.widthBank<<" reg="<<cfg.widthReg<<" addr="<<cfg.widthAddr<<"\n";
                 }
+                else if (tok[1]=="journal" && tok.size()>=3 && (tok[2]=="on" || tok[2]=="off")){
+                    cfg.journal = tok[2]=="on";
+                    if (!cfg.journal) closeJournals();
+                    saveCfg(); std::cout<<"journal="<<tok[2]<<"\n";
+                }
                 else std::cout<<"Unknown :set option\n";
                 continue;
             }
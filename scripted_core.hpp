@@ -7,9 +7,9 @@
 #include <string_view>
 #include <vector>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
-#include <regex>
 #include <filesystem>
 #include <fstream>
 #include <cstdlib>
@@ -18,6 +18,45 @@
 #include <cctype>
 #include <limits>
 #include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <new>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/uio.h>
+#else
+  #include <io.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+#endif
+#include <cerrno>
+#include <bit>
+#include <span>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define SCRIPTED_X86 1
+  #include <immintrin.h>
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+    #define SCRIPTED_TARGET_AVX2
+  #else
+    #define SCRIPTED_TARGET_AVX2 __attribute__((target("avx2")))
+  #endif
+#endif
 
 namespace scripted {
 
@@ -60,40 +99,141 @@ inline string trim(string s) {
     s.erase(std::find_if(s.rbegin(), s.rend(), notspace).base(), s.end());
     return s;
 }
+// ----------------------------- Id digits -----------------------------
+// Ids are written in cfg.base with lowercase digits and read back in either
+// case. Tables are built at compile time; bases 10, 16 and 36 (the usual
+// ones) get specialized loops with constant divisors, others a generic one.
+inline constexpr char kDigitChars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+inline constexpr auto kDigitValues = []{
+    std::array<signed char, 256> t{};
+    for (auto& v : t) v = -1;
+    for (int c = 0; c < 10; ++c) t['0' + c] = (signed char)c;
+    for (int c = 0; c < 26; ++c){ t['a' + c] = (signed char)(10 + c); t['A' + c] = (signed char)(10 + c); }
+    return t;
+}();
+
+// "00" "01" ... "99": two decimal digits per division.
+inline constexpr auto kDecimalPairs = []{
+    std::array<char, 200> t{};
+    for (int i = 0; i < 100; ++i){ t[2*i] = char('0' + i/10); t[2*i + 1] = char('0' + i%10); }
+    return t;
+}();
+
 inline int digitValue(char c){
-    if (c>='0' && c<='9') return c-'0';
-    if (c>='A' && c<='Z') return 10+(c-'A');
-    if (c>='a' && c<='z') return 10+(c-'a');
-    return -1;
+    return kDigitValues[(unsigned char)c];
+}
+
+// Digits of v written backwards ending at end; returns the first one.
+template<unsigned Base>
+inline char* writeDigits(unsigned long long v, char* end){
+    if constexpr (Base == 10){
+        while (v >= 100){
+            const unsigned r = unsigned(v % 100); v /= 100;
+            *--end = kDecimalPairs[2*r + 1];
+            *--end = kDecimalPairs[2*r];
+        }
+        if (v >= 10){ *--end = kDecimalPairs[2*v + 1]; *--end = kDecimalPairs[2*v]; }
+        else *--end = char('0' + v);
+    }
+    else if constexpr (Base == 16){
+        do { *--end = kDigitChars[v & 15]; v >>= 4; } while (v);
+    }
+    else {
+        do { *--end = kDigitChars[v % Base]; v /= Base; } while (v);
+    }
+    return end;
+}
+inline char* writeDigits(unsigned long long v, unsigned base, char* end){
+    switch (base){
+    case 10: return writeDigits<10>(v, end);
+    case 16: return writeDigits<16>(v, end);
+    case 36: return writeDigits<36>(v, end);
+    default:
+        do { *--end = kDigitChars[v % base]; v /= base; } while (v);
+        return end;
+    }
 }
-inline bool parseIntBase(const string& s, int base, long long& out){
+
+// Accumulates in unsigned arithmetic so overflow wraps as it always has;
+// a result that went negative is rejected.
+template<unsigned Base>
+inline bool readDigits(std::string_view s, long long& out){
+    unsigned long long v = 0;
+    for (char c : s){
+        const int d = kDigitValues[(unsigned char)c];
+        if (d < 0 || d >= int(Base)) return false;
+        v = v*Base + unsigned(d);
+        if ((long long)v < 0) return false;
+    }
+    out = (long long)v;
+    return true;
+}
+
+inline bool parseIntBase(std::string_view s, int base, long long& out){
     if (s.empty()) return false;
-    long long v=0;
-    for (char c: s){
-        int d = digitValue(c);
-        if (d<0 || d>=base) return false;
-        v = v*base + d;
-        if (v < 0) return false;
+    switch (base){
+    case 10: return readDigits<10>(s, out);
+    case 16: return readDigits<16>(s, out);
+    case 36: return readDigits<36>(s, out);
+    default: break;
     }
-    out = v;
+    unsigned long long v = 0;
+    for (char c : s){
+        const int d = kDigitValues[(unsigned char)c];
+        if (d < 0 || d >= base) return false;
+        v = v*unsigned(base) + unsigned(d);
+        if ((long long)v < 0) return false;
+    }
+    out = (long long)v;
     return true;
 }
-inline string toBaseN(long long val, int base, int width){
+
+// Appends val in base, zero-padded on the left to width; a negative value
+// is padded outside its sign ("00-5"), as ids have always been.
+inline void appendBaseN(string& out, long long val, int base, int width){
     if (base<2 || base>36) base=10;
-    if (val==0) return string(std::max(1,width),'0');
-    bool neg = val<0; if (neg) val = -val;
+    char buf[72];
+    char* const end = buf + sizeof buf;
+    const unsigned long long mag = val < 0 ? 0ull - (unsigned long long)val : (unsigned long long)val;
+    char* p = writeDigits(mag, unsigned(base), end);
+    if (val < 0) *--p = '-';
+    const size_t n = size_t(end - p);
+    if (width > 0 && n < size_t(width)) out.append(size_t(width) - n, '0');
+    out.append(p, n);
+}
+
+inline string toBaseN(long long val, int base, int width){
     string s;
-    while (val>0){
-        int d = int(val%base);
-        s.push_back(d<10? char('0'+d) : char('a'+(d-10)));
-        val/=base;
-    }
-    if (neg) s.push_back('-');
-    std::reverse(s.begin(), s.end());
-    if (width>0 && (int)s.size()<width) s = string(width - (int)s.size(),'0') + s;
+    appendBaseN(s, val, base, width);
     return s;
 }
 
+// A column of ids formatted into one buffer, e.g. for a table refresh: one
+// allocation for the text instead of a string per id.
+struct IdColumn {
+    string text;
+    std::vector<size_t> ends;
+    size_t size() const { return ends.size(); }
+    std::string_view operator[](size_t i) const {
+        const size_t b = i ? ends[i-1] : 0;
+        return std::string_view(text).substr(b, ends[i] - b);
+    }
+};
+
+// id(item) gives the id to format for each item of items.
+template<class Items, class Id>
+inline IdColumn formatIdColumn(const Items& items, Id id, int base, int width){
+    IdColumn col;
+    col.ends.reserve(std::size(items));
+    col.text.reserve(std::size(items) * size_t(std::max(width, 4)));
+    for (const auto& item : items){
+        appendBaseN(col.text, id(item), base, width);
+        col.ends.push_back(col.text.size());
+    }
+    return col;
+}
+
 // ----------------------------- Config/Paths/Model -----------------------------
 struct Config {
     char prefix = 'x';
@@ -101,6 +241,7 @@ struct Config {
     int  widthBank = 5;
     int  widthReg  = 2;
     int  widthAddr = 4;
+    bool journal = false;  // log edits to files/<ctx>.wal (see "Edit journal")
 
     string toJSON() const {
         std::ostringstream os;
@@ -109,7 +250,8 @@ struct Config {
         os << "  \"base\": " << base << ",\n";
         os << "  \"widthBank\": " << widthBank << ",\n";
         os << "  \"widthReg\": " << widthReg << ",\n";
-        os << "  \"widthAddr\": " << widthAddr << "\n";
+        os << "  \"widthAddr\": " << widthAddr << ",\n";
+        os << "  \"journal\": " << (journal ? "true" : "false") << "\n";
         os << "}\n";
         return os.str();
     }
@@ -132,12 +274,21 @@ struct Config {
             string num = trim(j.substr(p+1, q-(p+1)));
             try { return std::stoi(num); } catch(...) { return def; }
         };
+        auto getBool=[&](const string& key, bool def)->bool{
+            auto p = j.find("\""+key+"\"");
+            if (p==string::npos) return def;
+            p = j.find(':', p); if (p==string::npos) return def;
+            auto q = j.find_first_of(",\n}", p+1);
+            string v = trim(j.substr(p+1, q-(p+1)));
+            return v=="true" ? true : v=="false" ? false : def;
+        };
         string pf = getStr("prefix", "\"x\"");
         if (pf.size()>=2) c.prefix = pf[1];
         c.base       = getInt("base", 10);
         c.widthBank  = getInt("widthBank", 5);
         c.widthReg   = getInt("widthReg", 2);
         c.widthAddr  = getInt("widthAddr", 4);
+        c.journal    = getBool("journal", false);
         return c;
     }
 };
@@ -152,420 +303,4126 @@ struct Paths {
     }
 };
 
-struct Bank {
-    long long id = 0;
-    string title;
-    // reg -> (addr -> value)
-    std::map<long long, std::map<long long, string>> regs;
-    bool empty() const {
-        if (regs.empty()) return true;
-        for (auto& [r, addrs] : regs) if (!addrs.empty()) return false;
-        return true;
-    }
-};
-
-struct Workspace {
-    std::map<long long, Bank> banks;       // id -> Bank
-    std::map<long long, string> filenames; // id -> path
+// ----------------------------- Reference lexer -----------------------------
+// Single left-to-right pass over a cell value that finds the three reference
+// forms understood by the Resolver:
+//   @file(<name>)          include, name is everything up to the next ')'
+//   <dec>.<dec>.<dec>      three-part numeric  b.r.a
+//   <L><tok>.<tok>         two-part prefixed   x<bank>.<addr>, tok = [0-9A-Za-z]+
+// Matches are leftmost and greedy like the regexes this replaces; a three-part
+// reference wins over a two-part candidate that overlaps it (the numeric pass
+// used to run first). Text substituted for a reference is never re-scanned.
+struct RefSpan {
+    enum Kind : unsigned char { File, Three, Two };
+    Kind kind = File;
+    size_t pos = 0, len = 0;   // whole match within the scanned text
+    char prefix = 0;           // Two: the leading letter
+    std::string_view a, b, c;  // File: a=name | Three: a.b.c | Two: a=bank, b=addr
 };
 
-// ----------------------------- Parsing & I/O -----------------------------
-struct ParseResult { bool ok=true; string err; };
-
-inline ParseResult parseBankText(const string& text, const Config& cfg, Bank& outBank) {
-    std::vector<string> lines;
-    {
-        std::istringstream is(text);
-        string line;
-        while (std::getline(is, line)) lines.push_back(line);
-    }
-    if (lines.empty()) return {false, "empty file"};
-    size_t i=0;
-    while (i<lines.size() && trim(lines[i]).empty()) i++;
-    if (i==lines.size()) return {false, "no header found"};
-    string header = trim(lines[i]);
-
-    string headerAccum = header;
-    size_t j=i+1;
-    while (headerAccum.find('{')==string::npos && j<lines.size()){
-        headerAccum += " " + trim(lines[j]);
-        j++;
-    }
-    if (headerAccum.find('{')==string::npos) return {false, "missing '{' after header"};
-
-    size_t lp = headerAccum.find('(');
-    size_t rp = headerAccum.rfind(')');
-    if (lp==string::npos || rp==string::npos || rp<lp) return {false, "malformed header: parentheses"};
-    string left  = trim(headerAccum.substr(0, lp));
-    string title = trim(headerAccum.substr(lp+1, rp-lp-1));
-
-    if (!left.empty() && left[0]==cfg.prefix) left = left.substr(1);
-    long long bankId;
-    if (!parseIntBase(left, cfg.base, bankId)) return {false, "cannot parse bank id"};
-
-    outBank = {};
-    outBank.id = bankId;
-    outBank.title = title;
-
-    size_t bodyStartLine = i;
-    while (bodyStartLine<lines.size() && lines[bodyStartLine].find('{')==string::npos) bodyStartLine++;
-    if (bodyStartLine==lines.size()) return {false, "missing body start"};
-    bodyStartLine++;
+inline bool isAsciiDigit(char c){ return c>='0' && c<='9'; }
+inline bool isAsciiAlpha(char c){ return (c>='A' && c<='Z') || (c>='a' && c<='z'); }
+inline bool isAsciiAlnum(char c){ return isAsciiDigit(c) || isAsciiAlpha(c); }
 
-    long long currentReg = 1;
-    for (size_t k=bodyStartLine; k<lines.size(); ++k){
-        string s = lines[k];
-        if (s.find('}')!=string::npos) break;
-        if (trim(s).empty()) continue;
-
-        if (!s.empty() && s[0] != '\t'){
-            long long regId;
-            if (!parseIntBase(trim(s), cfg.base, regId)){
-                return {false, "invalid register line: " + trim(s)};
-            }
-            currentReg = regId;
-            continue;
-        }
-        string t = s;
-        while (!t.empty() && (t[0]=='\t' || t[0]==' ')) t.erase(t.begin());
-        size_t sep = t.find('\t');
-        if (sep==string::npos) sep = t.find(' ');
-        string addrTok, val;
-        if (sep==string::npos){ addrTok = trim(t); val=""; }
-        else { addrTok = trim(t.substr(0, sep)); val = t.substr(sep+1); }
-
-        long long addrId;
-        if (!parseIntBase(addrTok, cfg.base, addrId))
-            return {false, "invalid address id: " + addrTok};
-        outBank.regs[currentReg][addrId] = val;
+inline bool parseDecimal(std::string_view s, long long& out){
+    if (s.empty()) return false;
+    long long v=0;
+    for (char c: s){
+        if (!isAsciiDigit(c)) return false;
+        if (v > (std::numeric_limits<long long>::max() - (c-'0')) / 10) return false;
+        v = v*10 + (c-'0');
     }
-    return {};
+    out = v;
+    return true;
 }
 
-inline string writeBankText(const Bank& b, const Config& cfg){
-    std::ostringstream os;
-    string bankStr = string(1,cfg.prefix) + toBaseN(b.id, cfg.base, cfg.widthBank);
-    os << bankStr << "\t(" << b.title << "){\n";
-    bool multi = (b.regs.size()>1) || (b.regs.size()==1 && b.regs.begin()->first!=1);
-    if (!multi){
-        auto it = b.regs.find(1);
-        if (it != b.regs.end()){
-            for (auto& [aid, val] : it->second){
-                os << "\t" << toBaseN(aid, cfg.base, cfg.widthAddr) << "\t" << val << "\n";
+namespace detail {
+inline size_t digitsEnd(std::string_view s, size_t i){
+    while (i<s.size() && isAsciiDigit(s[i])) ++i;
+    return i;
+}
+inline size_t alnumEnd(std::string_view s, size_t i){
+    while (i<s.size() && isAsciiAlnum(s[i])) ++i;
+    return i;
+}
+// <dec>.<dec>.<dec> starting at a digit; i must be the start of a digit run.
+inline bool matchThree(std::string_view s, size_t i, RefSpan& m){
+    size_t e1 = digitsEnd(s, i);
+    if (e1==i || e1>=s.size() || s[e1]!='.') return false;
+    size_t e2 = digitsEnd(s, e1+1);
+    if (e2==e1+1 || e2>=s.size() || s[e2]!='.') return false;
+    size_t e3 = digitsEnd(s, e2+1);
+    if (e3==e2+1) return false;
+    m.kind = RefSpan::Three; m.pos = i; m.len = e3-i;
+    m.a = s.substr(i, e1-i); m.b = s.substr(e1+1, e2-e1-1); m.c = s.substr(e2+1, e3-e2-1);
+    return true;
+}
+// <L><tok>.<tok> starting at a letter.
+inline bool matchTwo(std::string_view s, size_t i, RefSpan& m){
+    size_t e1 = alnumEnd(s, i+1);
+    if (e1==i+1 || e1>=s.size() || s[e1]!='.') return false;
+    size_t e2 = alnumEnd(s, e1+1);
+    if (e2==e1+1) return false;
+    m.kind = RefSpan::Two; m.pos = i; m.len = e2-i; m.prefix = s[i];
+    m.a = s.substr(i+1, e1-i-1); m.b = s.substr(e1+1, e2-e1-1); m.c = {};
+    return true;
+}
+} // namespace detail
+
+// Calls fn(const RefSpan&) for every reference in s, in order.
+template <class Fn>
+inline void scanRefs(std::string_view s, bool allowFile, Fn&& fn){
+    static constexpr std::string_view kFile = "@file(";
+    const size_t n = s.size();
+    size_t i = 0;
+    RefSpan m;
+    while (i<n){
+        char c = s[i];
+        if (c=='@' && allowFile && s.substr(i, kFile.size())==kFile){
+            size_t open = i + kFile.size();
+            size_t close = s.find(')', open);
+            if (close!=std::string_view::npos && close>open){
+                m = {}; m.kind = RefSpan::File; m.pos = i; m.len = close+1-i;
+                m.a = s.substr(open, close-open);
+                fn(m);
+                i = close+1;
+                continue;
             }
-        }
-    } else {
-        for (auto& [rid, addrs] : b.regs){
-            os << toBaseN(rid, cfg.base, cfg.widthReg) << "\n";
-            for (auto& [aid, val] : addrs){
-                os << "\t" << toBaseN(aid, cfg.base, cfg.widthAddr) << "\t" << val << "\n";
+            ++i;
+        } else if (isAsciiDigit(c)){
+            if (detail::matchThree(s, i, m)) { fn(m); i = m.pos + m.len; }
+            else i = detail::digitsEnd(s, i);
+        } else if (isAsciiAlpha(c)){
+            if (!detail::matchTwo(s, i, m)) { i = detail::alnumEnd(s, i); continue; }
+            // A numeric b.r.a starting inside the candidate takes precedence.
+            size_t end = m.pos + m.len, cut = end;
+            RefSpan inner;
+            for (size_t k=i+1; k<end; ++k){
+                if (isAsciiDigit(s[k]) && !isAsciiDigit(s[k-1]) && detail::matchThree(s, k, inner)) { cut = k; break; }
             }
+            if (cut!=end && !detail::matchTwo(s.substr(0, cut), i, m)) { i = cut; continue; }
+            fn(m);
+            i = m.pos + m.len;
+        } else {
+            ++i;
         }
     }
-    os << "}\n";
-    return os.str();
 }
 
-inline fs::path contextFileName(const Config& cfg, long long bankId){
-    return fs::path("files") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".txt");
-}
-inline fs::path outResolvedName(const Config& cfg, long long bankId){
-    return fs::path("files/out") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".resolved.txt");
-}
-inline fs::path outJsonName(const Config& cfg, long long bankId){
-    return fs::path("files/out") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".json");
-}
+// ----------------------------- Cell IR -----------------------------
+// A cell value compiled once into the references it contains. Literal text is
+// the gap between consecutive tokens (and before the first / after the last),
+// so a cell without references compiles to an empty list.
+struct RefToken {
+    enum Kind : unsigned char { File, Three, Two, BadRef, Missing };
+    Kind kind = File;
+    unsigned off = 0, len = 0;          // whole reference within the value
+    unsigned nameOff = 0, nameLen = 0;  // File: trimmed include name
+    long long bank = 0, reg = 0, addr = 0;
+};
+using CellIR = std::vector<RefToken>;
+// A cell's compiled references where they are stored: a bank's RefTable, a
+// CompiledBank or an IncludedFile. Empty for a cell without any.
+using CellRefs = std::span<const RefToken>;
 
-inline bool loadContextFile(const Config& cfg, const fs::path& file, Bank& bank, string& err){
-    if (!fs::exists(file)) { err = "file not found: " + file.string(); return false; }
-    std::ifstream in(file, std::ios::binary);
-    if (!in){ err="cannot open: " + file.string(); return false; }
-    string text( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
-    ParseResult pr = parseBankText(text, cfg, bank);
-    if (!pr.ok) { err = pr.err; return false; }
-    return true;
+// Identifies the Config fields the IR depends on; 0 means "never compiled".
+inline unsigned irStamp(const Config& cfg){
+    return 1u + ((unsigned)(unsigned char)cfg.prefix << 8) + (unsigned)cfg.base;
 }
-// --- saveContextFile: ensure dirs; write atomically-ish -------------------
-inline bool saveContextFile(const Config& cfg,
-                            const std::filesystem::path& path,
-                            const Bank& b,
-                            std::string& err)
-{
-    try {
-        std::filesystem::create_directories(path.parent_path());
 
-        // Write to a temp file first
-        auto tmp = path; tmp += ".tmp";
-        {
-            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
-            if (!out) { err = "Cannot open temp file for write: " + tmp.string(); return false; }
-            std::string text = writeBankText(b, cfg);
-            out.write(text.data(), (std::streamsize)text.size());
-            if (!out) { err = "Write failed: " + tmp.string(); return false; }
+inline CellIR compileCell(std::string_view value, const Config& cfg, bool allowFile = true){
+    CellIR ir;
+    scanRefs(value, allowFile, [&](const RefSpan& m){
+        RefToken t;
+        t.off = (unsigned)m.pos; t.len = (unsigned)m.len;
+        switch (m.kind){
+        case RefSpan::File: {
+            size_t b = 0, e = m.a.size();
+            while (b<e && std::isspace((unsigned char)m.a[b])) ++b;
+            while (e>b && std::isspace((unsigned char)m.a[e-1])) --e;
+            t.kind = RefToken::File;
+            t.nameOff = (unsigned)(m.a.data() - value.data() + b); t.nameLen = (unsigned)(e-b);
+            break;
         }
-
-        // Replace the target (works across volumes with fallback)
-        std::error_code ec;
-        std::filesystem::rename(tmp, path, ec);
-        if (ec) {
-            std::filesystem::copy_file(tmp, path,
-                std::filesystem::copy_options::overwrite_existing, ec);
-            std::filesystem::remove(tmp);
-            if (ec) { err = "Replace failed: " + path.string() + " (" + ec.message() + ")"; return false; }
+        case RefSpan::Three:
+            t.kind = RefToken::Three;
+            if (!parseDecimal(m.a, t.bank) || !parseDecimal(m.b, t.reg) || !parseDecimal(m.c, t.addr))
+                t.kind = RefToken::Missing;
+            break;
+        case RefSpan::Two:
+            if (m.prefix != cfg.prefix) return;  // someone else's prefix: plain text
+            t.kind = RefToken::Two; t.reg = 1;
+            if (!parseIntBase(string(m.a), cfg.base, t.bank) || !parseIntBase(string(m.b), cfg.base, t.addr))
+                t.kind = RefToken::BadRef;
+            break;
         }
-        return true;
-    } catch (const std::exception& e) {
-        err = e.what();
-        return false;
-    }
+        ir.push_back(t);
+    });
+    return ir;
 }
 
+// ----------------------------- Cell values -----------------------------
+// Cell values live in ValueArena chunks: kChunkSize-aligned blocks carved
+// up by bumping a pointer, so loading a bank costs one allocation per
+// chunk instead of one per cell. A cell holds a CellValue, an 8-byte
+// counted handle to an immutable {refs, size, hash, bytes} block. A chunk
+// counts its live blocks (plus one while it is an arena's current chunk)
+// and is freed with the last of them, whichever bank or thread drops it;
+// values longer than kLargeValue are plain heap allocations instead.
+//
+// Values are interned: ValuePool indexes every live block by content, so
+// a value repeated across cells and banks is stored once and shared. The
+// pool is process-wide, so banks parsed off the Workspace (parallel parse
+// chunks, pipeline stages) share with it too.
+struct ValueBlock {
+    std::atomic<std::uint32_t> refs;
+    std::uint32_t size;
+    std::uint32_t hash;
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    std::string_view view() const { return {data(), size}; }
+};
+struct ValueChunk {
+    std::atomic<size_t> blocks;
+    size_t bytes;
+};
 
-inline bool ensureBankLoadedInWorkspace(const Config& cfg, Workspace& ws, long long bankId, string& err){
-    if (ws.banks.count(bankId)) return true;
-    fs::path file = contextFileName(cfg, bankId);
-    if (!fs::exists(file)) { err = "missing context file: " + file.string(); return false; }
-    Bank b;
-    if (!loadContextFile(cfg, file, b, err)) return false;
-    ws.banks[bankId] = std::move(b);
-    ws.filenames[bankId] = file.string();
-    return true;
-}
+class ValueArena {
+public:
+    static constexpr size_t kChunkSize = 256 * 1024;
+    static constexpr size_t kLargeValue = kChunkSize / 4;
 
-// ----------------------------- Resolver (both styles active) -----------------------------
-struct Resolver {
-    const Config& cfg;
-    Workspace& ws;
-    Resolver(const Config& c, Workspace& w): cfg(c), ws(w) {}
+    ValueArena() = default;
+    // A copy starts with no chunk of its own; values are shared by handle.
+    ValueArena(const ValueArena&) {}
+    ValueArena& operator=(const ValueArena&){ return *this; }
+    ValueArena(ValueArena&& o) noexcept: chunk(o.chunk), cur(o.cur), end(o.end) { o.chunk = nullptr; o.cur = o.end = nullptr; }
+    ValueArena& operator=(ValueArena&& o) noexcept {
+        if (this != &o){ retire(); chunk = o.chunk; cur = o.cur; end = o.end; o.chunk = nullptr; o.cur = o.end = nullptr; }
+        return *this;
+    }
+    ~ValueArena(){ retire(); }
 
-    bool getValue(long long bank, long long reg, long long addr, string& out) const {
-        string err;
-        (void)ensureBankLoadedInWorkspace(cfg, const_cast<Workspace&>(ws), bank, err);
-        auto itB = ws.banks.find(bank);
-        if (itB==ws.banks.end()) return false;
-        const auto& b = itB->second;
-        auto itR = b.regs.find(reg);
-        if (itR==b.regs.end()) return false;
-        auto itA = itR->second.find(addr);
-        if (itA==itR->second.end()) return false;
-        out = itA->second;
-        return true;
+    // A block holding s with one reference.
+    ValueBlock* allocate(std::string_view s, std::uint32_t hash){
+        const size_t need = blockBytes(s.size());
+        ValueBlock* b;
+        if (s.size() > kLargeValue){
+            reserved().fetch_add(need, std::memory_order_relaxed);
+            b = static_cast<ValueBlock*>(::operator new(need));
+        }
+        else {
+            if (size_t(end - cur) < need){
+                retire();
+                chunk = newChunk(kChunkSize);
+                chunk->blocks.store(1, std::memory_order_relaxed);
+                cur = reinterpret_cast<char*>(chunk + 1);
+                end = reinterpret_cast<char*>(chunk) + kChunkSize;
+            }
+            b = reinterpret_cast<ValueBlock*>(cur);
+            cur += need;
+            chunk->blocks.fetch_add(1, std::memory_order_relaxed);
+        }
+        ::new (b) ValueBlock{{1}, std::uint32_t(s.size()), hash};
+        if (!s.empty()) std::memcpy(const_cast<char*>(b->data()), s.data(), s.size());
+        return b;
     }
-    bool getValueTwoPart(long long bank, long long addr, string& out) const {
-        string err;
-        (void)ensureBankLoadedInWorkspace(cfg, const_cast<Workspace&>(ws), bank, err);
-        return getValue(bank, 1, addr, out);
+
+    // Frees a block nothing refers to any more; frees its chunk with the last.
+    static void release(ValueBlock* b){
+        if (b->size > kLargeValue){
+            reserved().fetch_sub(blockBytes(b->size), std::memory_order_relaxed);
+            b->~ValueBlock();
+            ::operator delete(b);
+            return;
+        }
+        auto* c = reinterpret_cast<ValueChunk*>(reinterpret_cast<std::uintptr_t>(b) & ~std::uintptr_t(kChunkSize - 1));
+        dropChunk(c);
     }
-    string includeFile(const string& name) const {
-        fs::path p = fs::path("files") / name;
-        if (!fs::exists(p)) return string("[Missing file: ")+name+"]";
-        std::ifstream in(p, std::ios::binary);
-        if (!in) return string("[Cannot open file: ")+name+"]";
-        return string( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
-    }
-
-    string resolve(const string& input, long long currentBank, std::unordered_set<string>& visited) const {
-        string s = input;
-        {   // @file(...)
-            static std::regex fileRe(R"(@file\(([^)]+)\))");
-            std::smatch m; string out; out.reserve(s.size());
-            string::const_iterator searchStart( s.cbegin() ); size_t last = 0;
-            while (std::regex_search(searchStart, s.cend(), m, fileRe)) {
-                size_t pos = m.position(0) + (searchStart - s.cbegin());
-                size_t len = m.length(0);
-                out.append(s, last, pos - last);
-                string fname = trim(m[1].str());
-                out += includeFile(fname);
-                searchStart = s.cbegin() + pos + len;
-                last = pos + len;
-            }
-            out.append(s, last, string::npos);
-            s.swap(out);
-        }
-        {   // three-part numeric: b.r.a
-            static std::regex tri(R"((\d+)\.(\d+)\.(\d+))");
-            std::smatch m; string out; out.reserve(s.size());
-            string::const_iterator searchStart( s.cbegin() ); size_t last = 0;
-            while (std::regex_search(searchStart, s.cend(), m, tri)) {
-                size_t pos = m.position(0) + (searchStart - s.cbegin());
-                size_t len = m.length(0);
-                out.append(s, last, pos - last);
-                long long b = std::stoll(m[1].str());
-                long long r = std::stoll(m[2].str());
-                long long a = std::stoll(m[3].str());
-                string key = std::to_string(b)+"."+std::to_string(r)+"."+std::to_string(a);
-                if (visited.count(key)) out += "[Circular Ref: " + m[0].str() + "]";
-                else {
-                    string v;
-                    if (!getValue(b, r, a, v)) out += "[Missing " + m[0].str() + "]";
-                    else { auto v2=visited; v2.insert(key); out += resolve(v, b, v2); }
-                }
-                searchStart = s.cbegin() + pos + len; last = pos + len;
-            }
-            out.append(s, last, string::npos);
-            s.swap(out);
-        }
-        {   // two-part prefixed: x<bank>.<addr>
-            static std::regex two(R"(([A-Za-z])([0-9A-Za-z]+)\.([0-9A-Za-z]+))");
-            std::smatch m; string out; out.reserve(s.size());
-            string::const_iterator searchStart( s.cbegin() ); size_t last = 0;
-            while (std::regex_search(searchStart, s.cend(), m, two)) {
-                size_t pos = m.position(0) + (searchStart - s.cbegin());
-                size_t len = m.length(0);
-                out.append(s, last, pos - last);
-                char pf = m[1].str()[0];
-                if (pf != cfg.prefix) out += m[0].str();
-                else {
-                    long long b=0, a=0;
-                    if (!parseIntBase(m[2].str(), cfg.base, b) || !parseIntBase(m[3].str(), cfg.base, a)) {
-                        out += "[BadRef " + m[0].str() + "]";
-                    } else {
-                        string key = string(1, pf) + m[2].str() + "." + m[3].str();
-                        if (visited.count(key)) out += "[Circular Ref: " + m[0].str() + "]";
-                        else {
-                            string v;
-                            if (!getValueTwoPart(b, a, v)) out += "[Missing " + m[0].str() + "]";
-                            else { auto v2=visited; v2.insert(key); out += resolve(v, b, v2); }
-                        }
-                    }
-                }
-                searchStart = s.cbegin() + pos + len; last = pos + len;
-            }
-            out.append(s, last, string::npos);
-            s.swap(out);
+
+    // Bytes of chunks and large values currently allocated, across all arenas.
+    static size_t reservedBytes(){ return reserved().load(std::memory_order_relaxed); }
+
+private:
+    static size_t blockBytes(size_t n){ return (sizeof(ValueBlock) + n + alignof(ValueBlock) - 1) & ~(alignof(ValueBlock) - 1); }
+    static std::atomic<size_t>& reserved(){ static std::atomic<size_t> n{0}; return n; }
+    static ValueChunk* newChunk(size_t bytes){
+        reserved().fetch_add(bytes, std::memory_order_relaxed);
+        return ::new (::operator new(bytes, std::align_val_t(kChunkSize))) ValueChunk{{0}, bytes};
+    }
+    static void dropChunk(ValueChunk* c){
+        if (c->blocks.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            reserved().fetch_sub(c->bytes, std::memory_order_relaxed);
+            c->~ValueChunk();
+            ::operator delete(c, std::align_val_t(kChunkSize));
         }
-        return s;
     }
+    void retire(){
+        if (chunk) dropChunk(chunk);
+        chunk = nullptr; cur = end = nullptr;
+    }
+
+    ValueChunk* chunk = nullptr;
+    char* cur = nullptr;
+    char* end = nullptr;
 };
 
-// ----------------------------- Config file helpers -----------------------------
-inline void ensurePaths(const Paths& P){ P.ensure(); }
-inline Config loadConfig(const Paths& P){
-    ensurePaths(P);
-    Config cfg;
-    if (fs::exists(P.config)) {
-        std::ifstream in(P.config);
-        string j( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
-        cfg = Config::fromJSON(j);
-    } else {
-        std::ofstream out(P.config);
-        out << cfg.toJSON();
+class ValuePool;
+
+class CellValue {
+public:
+    CellValue() = default;
+    // s, interned; a new block comes from `arena`.
+    CellValue(ValueArena& arena, std::string_view s);
+    CellValue(const CellValue& o): b(o.b) { retain(); }
+    CellValue(CellValue&& o) noexcept: b(o.b) { o.b = nullptr; }
+    CellValue& operator=(const CellValue& o){ CellValue t(o); std::swap(b, t.b); return *this; }
+    CellValue& operator=(CellValue&& o) noexcept { std::swap(b, o.b); return *this; }
+    ~CellValue(){ drop(); }
+
+    std::string_view view() const { return b ? b->view() : std::string_view(); }
+    operator std::string_view() const { return view(); }
+    const char* data() const { return b ? b->data() : ""; }
+    size_t size() const { return b ? b->size : 0; }
+    bool empty() const { return size() == 0; }
+    // The block itself, for indexes that point at values a bank holds.
+    const ValueBlock* block() const { return b; }
+
+    friend bool operator==(const CellValue& x, const CellValue& y){ return x.b == y.b || x.view() == y.view(); }
+    friend bool operator==(const CellValue& x, std::string_view y){ return x.view() == y; }
+    friend std::ostream& operator<<(std::ostream& os, const CellValue& v){ return os << v.view(); }
+
+private:
+    friend class ValuePool;
+    explicit CellValue(ValueBlock* adopt): b(adopt) {}
+    // "" for every arena; never freed or interned.
+    static ValueBlock* emptyBlock(){
+        static ValueBlock e{{1}, 0, 0};
+        return &e;
     }
-    return cfg;
-}
-inline void saveConfig(const Paths& P, const Config& cfg){
-    std::ofstream out(P.config);
-    out << cfg.toJSON();
-}
+    void retain() const { if (b && b != emptyBlock()) b->refs.fetch_add(1, std::memory_order_relaxed); }
+    inline void drop();
+    ValueBlock* b = nullptr;
+};
 
-// ----------------------------- Utility ops used by CLI/GUI -----------------------------
-// --- openCtx: load-or-create without testing writability ------------------
-inline bool openCtx(const Config& cfg,
-                    Workspace& ws,
-                    std::string nameOrStem,
-                    std::string& status)
-{
-    // Normalize stem and compute id
-    std::string stem = nameOrStem;
-    if (stem.size() > 4 && stem.substr(stem.size() - 4) == ".txt")
-        stem.resize(stem.size() - 4);
+// Live blocks by content, in kShards independently locked open-addressing
+// tables of block pointers (linear probing on the hash kept in the block).
+// A block whose count reached zero is never handed out again, only removed.
+class ValuePool {
+public:
+    struct Totals { size_t values = 0, bytes = 0; };
 
-    std::string token = (!stem.empty() && stem[0] == cfg.prefix) ? stem.substr(1) : stem;
-    long long id = 0;
-    if (!parseIntBase(token, cfg.base, id)) {
-        status = "Bad context id: " + stem;
-        return false;
+    CellValue intern(ValueArena& arena, std::string_view s){
+        const std::uint32_t h = hashOf(s);
+        Shard& sh = shardOf(h);
+        std::lock_guard lk(sh.mu);
+        if ((sh.used + 1) * 4 > sh.slots.size() * 3) grow(sh);
+        const size_t mask = sh.slots.size() - 1;
+        size_t i = h & mask;
+        for (; sh.slots[i]; i = (i + 1) & mask){
+            ValueBlock* b = sh.slots[i];
+            if (b->hash != h || b->size != s.size() || std::memcmp(b->data(), s.data(), s.size()) != 0) continue;
+            std::uint32_t r = b->refs.load(std::memory_order_relaxed);
+            while (r != 0 && !b->refs.compare_exchange_weak(r, r + 1, std::memory_order_relaxed)) {}
+            if (r != 0) return CellValue(b);
+        }
+        ValueBlock* b = arena.allocate(s, h);
+        sh.slots[i] = b;
+        ++sh.used;
+        sh.bytes += s.size();
+        return CellValue(b);
     }
 
-    auto path = contextFileName(cfg, id);
-    Bank b;
+    // b's count reached zero: unindex and free it.
+    void forget(ValueBlock* b){
+        {
+            Shard& sh = shardOf(b->hash);
+            std::lock_guard lk(sh.mu);
+            if (const size_t i = slotOf(sh, b); i != npos){
+                erase(sh, i);
+                --sh.used;
+                sh.bytes -= b->size;
+            }
+        }
+        ValueArena::release(b);
+    }
 
-    if (std::filesystem::exists(path)) {
-        // OPEN FOR READING ONLY — opening must NOT fail if file is read-only
-        std::ifstream in(path, std::ios::binary);
-        if (!in) { status = "Cannot open: " + path.string(); return false; }
-        std::string text((std::istreambuf_iterator<char>(in)), {});
-        auto pr = parseBankText(text, cfg, b);
-        if (!pr.ok) { status = "Parse failed: " + pr.err; return false; }
-        if (b.title.empty()) b.title = stem;
-        ws.banks[id] = std::move(b);
-        status = "Opened " + path.string();
-        return true;
+    // Moves v's block into `fresh` if v is its only holder (see
+    // Bank::compactValues); shared blocks stay where they are.
+    void rehome(CellValue& v, ValueArena& fresh){
+        ValueBlock* b = v.b;
+        if (!b || b == CellValue::emptyBlock()) return;
+        Shard& sh = shardOf(b->hash);
+        std::lock_guard lk(sh.mu);
+        if (b->refs.load(std::memory_order_relaxed) != 1) return;
+        const size_t i = slotOf(sh, b);
+        if (i == npos) return;
+        // Same hash and content, so the copy takes the same slot.
+        sh.slots[i] = fresh.allocate(b->view(), b->hash);
+        v.b = sh.slots[i];
+        ValueArena::release(b);
     }
 
-    // New (empty) bank if file doesn't exist
-    b.title = stem;
-    ws.banks[id] = std::move(b);
-    status = "Created new context: " + path.string();
-    return true;
-}
+    Totals totals(){
+        Totals t;
+        for (Shard& sh : shards){
+            std::lock_guard lk(sh.mu);
+            t.values += sh.used;
+            t.bytes += sh.bytes;
+        }
+        return t;
+    }
 
+private:
+    static constexpr size_t kShards = 64;
+    static constexpr size_t npos = size_t(-1);
+    struct Shard {
+        std::mutex mu;
+        std::vector<ValueBlock*> slots;
+        size_t used = 0, bytes = 0;
+    };
 
-inline string resolveBankToText(const Config& cfg, Workspace& ws, long long bankId){
-    Resolver R(cfg, ws);
-    auto& b = ws.banks[bankId];
-    std::ostringstream os;
-    string bankStr = string(1,cfg.prefix) + toBaseN(b.id, cfg.base, cfg.widthBank);
-    os << bankStr << "\t(" << b.title << "){\n";
-    for (auto& [rid, addrs] : b.regs){
-        if (b.regs.size()>1) os << toBaseN(rid, cfg.base, cfg.widthReg) << "\n";
-        for (auto& [aid, val] : addrs){
-            std::unordered_set<string> visited;
-            string out = R.resolve(val, b.id, visited);
-            os << "\t" << toBaseN(aid, cfg.base, cfg.widthAddr) << "\t" << out << "\n";
+    static std::uint32_t hashOf(std::string_view s){
+        const std::uint64_t h = std::hash<std::string_view>{}(s);
+        return std::uint32_t(h ^ (h >> 32));
+    }
+    Shard& shardOf(std::uint32_t h){ return shards[(h >> 26) % kShards]; }
+    static size_t slotOf(const Shard& sh, const ValueBlock* b){
+        if (sh.slots.empty()) return npos;
+        const size_t mask = sh.slots.size() - 1;
+        for (size_t i = b->hash & mask; sh.slots[i]; i = (i + 1) & mask)
+            if (sh.slots[i] == b) return i;
+        return npos;
+    }
+    static void grow(Shard& sh){
+        std::vector<ValueBlock*> old(std::max<size_t>(64, sh.slots.size() * 2), nullptr);
+        old.swap(sh.slots);
+        const size_t mask = sh.slots.size() - 1;
+        for (ValueBlock* b : old){
+            if (!b) continue;
+            size_t i = b->hash & mask;
+            while (sh.slots[i]) i = (i + 1) & mask;
+            sh.slots[i] = b;
         }
     }
-    os << "}\n";
-    return os.str();
+    // Backward-shift deletion, so lookups never need tombstones.
+    static void erase(Shard& sh, size_t i){
+        const size_t mask = sh.slots.size() - 1;
+        for (size_t j = (i + 1) & mask; sh.slots[j]; j = (j + 1) & mask){
+            const size_t home = sh.slots[j]->hash & mask;
+            const bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+            if (!stays){ sh.slots[i] = sh.slots[j]; i = j; }
+        }
+        sh.slots[i] = nullptr;
+    }
+
+    std::array<Shard, kShards> shards;
+};
+
+// Never destroyed: handles in static objects may outlive any exit order.
+inline ValuePool& valuePool(){
+    static ValuePool* pool = new ValuePool;
+    return *pool;
 }
 
-inline string exportBankToJSON(const Config& cfg, Workspace& ws, long long bankId){
-    Resolver R(cfg, ws);
-    auto& b = ws.banks[bankId];
-    std::ostringstream os;
-    os << "{\n";
-    os << "  \"bank\": \""<< cfg.prefix<<toBaseN(b.id,cfg.base,cfg.widthBank) <<"\",\n";
-    os << "  \"title\": \""<< b.title <<"\",\n";
-    os << "  \"registers\": [\n";
-    bool firstR=true;
-    for (auto& [rid, addrs] : b.regs){
-        if (!firstR) os << ",\n"; firstR=false;
-        os << "    {\"id\":\""<<toBaseN(rid,cfg.base,cfg.widthReg)<<"\",\"addresses\":[\n";
-        bool firstA=true;
-        for (auto& [aid, val] : addrs){
-            if (!firstA) os << ",\n"; firstA=false;
-            std::unordered_set<string> visited;
-            string out = R.resolve(val, b.id, visited);
-            auto esc = [](const string& s){
-                string r; r.reserve(s.size()*11/10 + 8);
-                for (char c: s){
-                    if (c=='\\' || c=='"') { r.push_back('\\'); r.push_back(c); }
-                    else if (c=='\n') { r += "\\n"; }
-                    else r.push_back(c);
+inline CellValue::CellValue(ValueArena& arena, std::string_view s)
+    : CellValue(s.empty() ? CellValue(emptyBlock()) : valuePool().intern(arena, s)) {}
+
+inline void CellValue::drop(){
+    if (b && b != emptyBlock() && b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) valuePool().forget(b);
+    b = nullptr;
+}
+
+// ----------------------------- Perfect hashing -----------------------------
+// Minimal perfect hash over a fixed set of distinct 64-bit keys, by hash and
+// displace: keys fall into buckets of about two, and buckets are placed
+// largest first, each under the first seed that sends all its keys to free
+// slots; a lone key takes any free slot directly. find(k) is the position
+// k had in build()'s input, for a key of that set, and some position below
+// size() for any other key, so callers compare the key stored there. Costs
+// six bytes per key.
+class PerfectHash {
+public:
+    // False if some bucket found no seed, which in practice means two equal
+    // keys; find() is then unusable.
+    bool build(const std::vector<std::uint64_t>& keys){
+        seeds.clear(); at.clear();
+        const size_t n = keys.size();
+        if (!n) return true;
+        seeds.assign(n / 2 + 1, 0);
+        // Bucket members grouped flat: bucket b holds members[start[b], start[b+1]).
+        const size_t nb = seeds.size();
+        std::vector<std::uint32_t> bucket(n), start(nb + 1), members(n);
+        for (size_t i = 0; i < n; ++i) ++start[(bucket[i] = (std::uint32_t)bucketOf(keys[i])) + 1];
+        for (size_t b = 0; b < nb; ++b) start[b+1] += start[b];
+        {
+            std::vector<std::uint32_t> fill(start.begin(), start.end() - 1);
+            for (size_t i = 0; i < n; ++i) members[fill[bucket[i]]++] = (std::uint32_t)i;
+        }
+        // Buckets largest first (counting sort on size).
+        std::vector<std::uint32_t> order(nb);
+        {
+            size_t most = 0;
+            for (size_t b = 0; b < nb; ++b) most = std::max<size_t>(most, start[b+1] - start[b]);
+            std::vector<std::uint32_t> from(most + 2);
+            for (size_t b = 0; b < nb; ++b) ++from[most - (start[b+1] - start[b]) + 1];
+            for (size_t k = 0; k <= most; ++k) from[k+1] += from[k];
+            for (std::uint32_t b = 0; b < nb; ++b) order[from[most - (start[b+1] - start[b])]++] = b;
+        }
+        at.assign(n, 0);
+        std::vector<bool> taken(n);  // what the seed search probes: small enough to stay in cache
+        std::vector<std::uint64_t> groupKeys;
+        std::vector<size_t> slots;
+        size_t nextFree = 0;
+        for (std::uint32_t b : order){
+            const std::span<const std::uint32_t> group(members.data() + start[b], members.data() + start[b+1]);
+            if (group.empty()) break;
+            if (group.size() == 1){
+                while (taken[nextFree]) ++nextFree;
+                taken[nextFree] = true;
+                at[nextFree] = group[0];
+                seeds[b] = kDirect | (std::uint32_t)nextFree;
+                continue;
+            }
+            groupKeys.clear();
+            for (std::uint32_t i : group) groupKeys.push_back(keys[i]);
+            std::uint32_t seed = 1;
+            for (;; ++seed){
+                if (seed > kMaxSeed) return seeds.clear(), at.clear(), false;
+                slots.clear();
+                for (std::uint64_t k : groupKeys){
+                    const size_t sl = slotOf(k, seed, n);
+                    if (taken[sl] || std::find(slots.begin(), slots.end(), sl) != slots.end()) break;
+                    slots.push_back(sl);
                 }
-                return r;
-            };
-            os << "      {\"id\":\""<<toBaseN(aid,cfg.base,cfg.widthAddr)
-               <<"\",\"value\":\""<<esc(out)<<"\"}";
+                if (slots.size() == groupKeys.size()) break;
+            }
+            seeds[b] = seed;
+            for (size_t j = 0; j < slots.size(); ++j){ taken[slots[j]] = true; at[slots[j]] = group[j]; }
         }
-        os << "\n    ]}";
+        return true;
     }
-    os << "\n  ]\n";
-    os << "}\n";
-    return os.str();
-}
+    size_t size() const { return at.size(); }
+    size_t find(std::uint64_t key) const {
+        const std::uint32_t seed = seeds[bucketOf(key)];
+        return at[seed & kDirect ? seed & ~kDirect : slotOf(key, seed, at.size())];
+    }
+    void clear(){ *this = PerfectHash(); }
 
-inline void preloadAll(const Config& cfg, Workspace& ws){
-    for (auto& entry : fs::directory_iterator("files")){
-        if (!entry.is_regular_file()) continue;
+    static std::uint64_t mix(std::uint64_t x){
+        x ^= x >> 33; x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ull;
+        return x ^ (x >> 33);
+    }
+
+private:
+    static constexpr std::uint32_t kDirect = std::uint32_t(1) << 31;  // seed holds the slot itself
+    static constexpr std::uint32_t kMaxSeed = 1 << 16;
+    // Top 32 bits of h scaled to [0, n): a multiply instead of a division.
+    static size_t reduce(std::uint64_t h, size_t n){ return size_t(((h >> 32) * std::uint64_t(n)) >> 32); }
+    size_t bucketOf(std::uint64_t key) const { return reduce(mix(key), seeds.size()); }
+    static size_t slotOf(std::uint64_t key, std::uint32_t seed, size_t n){
+        return reduce(mix(key ^ (std::uint64_t(seed) * 0x9e3779b97f4a7c15ull)), n);
+    }
+
+    std::vector<std::uint32_t> seeds;  // per bucket
+    std::vector<std::uint32_t> at;     // slot -> position in the build() input
+};
+
+// ----------------------------- Register storage -----------------------------
+// addr -> value for one register, in addr order, in one of two forms picked
+// by fill ratio. A register whose cells cover at least half the addrs
+// between its first and last is dense: a plain vector indexed by
+// addr - base, with a null CellValue for each gap. Anything sparser is a
+// two-level B+tree: cells sorted in leaves of at most kLeafMax entries,
+// with `firsts` holding each leaf's first addr, which is what a lookup
+// binary-searches; an insert in the middle shifts one leaf and splits it
+// when full. A dense register goes sparse once under a quarter full (or
+// before an insert would take it there), so neither form flaps. Iterating
+// yields Cell{first = addr, second = value} in addr order either way, like
+// the std::map this replaced; bind it with `const auto&`. Pointers from
+// find() and references from iteration stay valid until the table is
+// modified, frozen or thawed. freeze() packs a sparse register that is only
+// read into one leaf with a PerfectHash over the addrs; modifying it thaws
+// it back into leaves. A dense register is already flat and stays as is.
+class AddrTable {
+public:
+    using Value = CellValue;
+private:
+    struct Entry { long long addr; Value value; };
+public:
+    static constexpr size_t kLeafMax = 256;
+
+    struct Cell { long long first; const Value& second; };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Cell;
+        using difference_type = std::ptrdiff_t;
+        using reference = Cell;
+        struct pointer { Cell c; const Cell* operator->() const { return &c; } };
+
+        const_iterator() = default;
+        Cell operator*() const {
+            if (t->dense_) return {t->base_ + (long long)i, t->dense[i]};
+            const Entry& e = t->leaves[leaf][i];
+            return {e.addr, e.value};
+        }
+        pointer operator->() const { return {**this}; }
+        const_iterator& operator++(){
+            if (t->dense_) i = t->nextDense(i + 1);
+            else if (++i == t->leaves[leaf].size()){ ++leaf; i = 0; }
+            return *this;
+        }
+        const_iterator operator++(int){ auto c = *this; ++*this; return c; }
+        bool operator==(const const_iterator& o) const { return leaf==o.leaf && i==o.i; }
+    private:
+        friend class AddrTable;
+        const_iterator(const AddrTable* t, size_t leaf, size_t i): t(t), leaf(leaf), i(i) {}
+        const AddrTable* t = nullptr;
+        size_t leaf = 0, i = 0;  // dense: i is the slot
+    };
+    using iterator = const_iterator;
+
+    const_iterator begin() const { return dense_ ? const_iterator{this, 0, nextDense(0)} : const_iterator{this, 0, 0}; }
+    const_iterator end() const { return dense_ ? const_iterator{this, 0, dense.size()} : const_iterator{this, leaves.size(), 0}; }
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    void clear(){
+        leaves.clear(); firsts.clear(); count_ = 0;
+        index.clear(); frozen_ = false;
+        dense.clear(); base_ = 0; dense_ = false;
+    }
+    bool frozen() const { return frozen_; }
+    bool isDense() const { return dense_; }
+
+    const Value* find(long long addr) const {
+        if (dense_){
+            if (addr < base_ || dist(base_, addr) >= dense.size()) return nullptr;
+            const Value& v = dense[size_t(dist(base_, addr))];
+            return v.block() ? &v : nullptr;
+        }
+        if (frozen_){
+            if (!count_) return nullptr;
+            const Entry& e = leaves[0][index.find(std::uint64_t(addr))];
+            return e.addr==addr ? &e.value : nullptr;
+        }
+        const size_t li = leafFor(addr);
+        if (li == npos) return nullptr;
+        const auto& leaf = leaves[li];
+        auto it = std::lower_bound(leaf.begin(), leaf.end(), addr, byAddr);
+        return it!=leaf.end() && it->addr==addr ? &it->value : nullptr;
+    }
+    size_t count(long long addr) const { return find(addr) ? 1 : 0; }
+
+    // Inserts or replaces; returns the value replaced, if any.
+    Value set(long long addr, Value value){
+        thaw();
+        if (empty() && leaves.empty()) dense_ = true;  // a new register starts dense
+        if (dense_){
+            if (setDense(addr, value)) return value;
+            toSparse();
+        }
+        if (leaves.empty() || addr > leaves.back().back().addr){
+            if (leaves.empty() || leaves.back().size() >= kLeafMax){
+                leaves.emplace_back().reserve(kLeafMax);
+                firsts.push_back(addr);
+            }
+            leaves.back().push_back({addr, std::move(value)});
+            ++count_;
+            adapt();
+            return {};
+        }
+        size_t li = leafFor(addr);
+        if (li == npos){ li = 0; firsts[0] = addr; }
+        auto& leaf = leaves[li];
+        auto it = std::lower_bound(leaf.begin(), leaf.end(), addr, byAddr);
+        if (it!=leaf.end() && it->addr==addr){ std::swap(it->value, value); return value; }
+        leaf.insert(it, {addr, std::move(value)});
+        ++count_;
+        if (leaf.size() > kLeafMax){
+            const size_t half = leaf.size() / 2;
+            std::vector<Entry> upper(std::make_move_iterator(leaf.begin() + half), std::make_move_iterator(leaf.end()));
+            leaf.erase(leaf.begin() + half, leaf.end());
+            firsts.insert(firsts.begin() + li + 1, upper.front().addr);
+            leaves.insert(leaves.begin() + li + 1, std::move(upper));
+        }
+        adapt();
+        return {};
+    }
+
+    bool erase(long long addr){
+        if (!find(addr)) return false;
+        if (dense_){
+            dense[size_t(dist(base_, addr))] = Value();
+            --count_;
+            while (!dense.empty() && !dense.back().block()) dense.pop_back();
+            adapt();
+            return true;
+        }
+        thaw();
+        const size_t li = leafFor(addr);
+        if (li == npos) return false;
+        auto& leaf = leaves[li];
+        auto it = std::lower_bound(leaf.begin(), leaf.end(), addr, byAddr);
+        if (it==leaf.end() || it->addr!=addr) return false;
+        leaf.erase(it);
+        --count_;
+        if (leaf.empty()){
+            leaves.erase(leaves.begin() + li);
+            firsts.erase(firsts.begin() + li);
+            adapt();
+            return true;
+        }
+        firsts[li] = leaf.front().addr;
+        // Fold a thinned-out leaf into its successor.
+        if (li + 1 < leaves.size() && leaf.size() + leaves[li+1].size() <= kLeafMax / 2){
+            auto& next = leaves[li+1];
+            leaf.insert(leaf.end(), std::make_move_iterator(next.begin()), std::make_move_iterator(next.end()));
+            leaves.erase(leaves.begin() + li + 1);
+            firsts.erase(firsts.begin() + li + 1);
+        }
+        adapt();
+        return true;
+    }
+
+    // Takes every cell of `later`; its values win on equal addrs. Leaves
+    // move over whole when both are sparse and `later` starts past this
+    // table's end.
+    void merge(AddrTable&& later){
+        if (later.empty()) return;
+        thaw();
+        later.thaw();
+        if (!dense_ && !later.dense_ && (empty() || later.firsts.front() > leaves.back().back().addr)){
+            leaves.insert(leaves.end(), std::make_move_iterator(later.leaves.begin()), std::make_move_iterator(later.leaves.end()));
+            firsts.insert(firsts.end(), later.firsts.begin(), later.firsts.end());
+            count_ += later.count_;
+            adapt();
+        }
+        else later.forEachValue([&](long long addr, Value& v){ set(addr, std::move(v)); });
+        later.clear();
+    }
+
+    void freeze(){
+        if (frozen_) return;
+        if (dense_){ dense.shrink_to_fit(); return; }
+        std::vector<Entry> all;
+        all.reserve(count_);
+        for (auto& leaf : leaves) all.insert(all.end(), std::make_move_iterator(leaf.begin()), std::make_move_iterator(leaf.end()));
+        leaves.clear(); firsts.clear();
+        std::vector<std::uint64_t> addrs;
+        addrs.reserve(all.size());
+        for (const Entry& e : all) addrs.push_back(std::uint64_t(e.addr));
+        if (!all.empty()){
+            firsts.push_back(all.front().addr);
+            leaves.push_back(std::move(all));
+        }
+        leaves.shrink_to_fit(); firsts.shrink_to_fit();
+        frozen_ = true;
+        if (!index.build(addrs)) thaw();
+    }
+    void thaw(){
+        if (!frozen_) return;
+        frozen_ = false;
+        index.clear();
+        if (leaves.empty()) return;
+        std::vector<Entry> all = std::move(leaves[0]);
+        leaves.clear(); firsts.clear();
+        for (size_t i = 0; i < all.size(); i += kLeafMax){
+            auto& leaf = leaves.emplace_back();
+            leaf.reserve(kLeafMax);
+            leaf.insert(leaf.end(), std::make_move_iterator(all.begin() + i),
+                        std::make_move_iterator(all.begin() + std::min(all.size(), i + kLeafMax)));
+            firsts.push_back(leaf.front().addr);
+        }
+    }
+
+    // Every stored value with its addr, in addr order, for re-homing them
+    // (see Bank::compactValues). f may move the value out.
+    template<class F>
+    void forEachValue(F&& f){
+        if (dense_){
+            for (size_t i = 0; i < dense.size(); ++i)
+                if (dense[i].block()) f(base_ + (long long)i, dense[i]);
+            return;
+        }
+        for (auto& leaf : leaves)
+            for (auto& e : leaf) f(e.addr, e.value);
+    }
+
+    bool operator==(const AddrTable& o) const {
+        return count_==o.count_ && std::equal(begin(), end(), o.begin(),
+                   [](const Cell& x, const Cell& y){ return x.first==y.first && x.second==y.second; });
+    }
+
+private:
+    static constexpr size_t npos = size_t(-1);
+    static bool byAddr(const Entry& e, long long a){ return e.addr < a; }
+
+    // Leaf whose range holds addr, or npos when addr precedes every leaf.
+    size_t leafFor(long long addr) const {
+        auto it = std::upper_bound(firsts.begin(), firsts.end(), addr);
+        return it==firsts.begin() ? npos : size_t(it - firsts.begin()) - 1;
+    }
+
+    // Fill-ratio thresholds over the addrs first..last: dense from half
+    // full, sparse again under a quarter.
+    static bool denseEnough(size_t filled, unsigned long long span){ return filled * 2 >= span; }
+    static bool tooSparse(size_t filled, unsigned long long span){ return filled * 4 < span; }
+    // to - from for to >= from, which may not fit in a long long.
+    static unsigned long long dist(long long from, long long to){ return (unsigned long long)to - (unsigned long long)from; }
+
+    size_t nextDense(size_t i) const {
+        while (i < dense.size() && !dense[i].block()) ++i;
+        return i;
+    }
+    // Dense set of addr; false (nothing changed) when the register would get
+    // too sparse for it. Swaps the old value, or null, into `value`.
+    bool setDense(long long addr, Value& value){
+        if (dense.empty()) base_ = addr;
+        if (addr >= base_ && dist(base_, addr) < dense.size()){
+            Value& slot = dense[size_t(dist(base_, addr))];
+            if (!slot.block()) ++count_;
+            std::swap(slot, value);
+            return true;
+        }
+        // Outside the slots: the span grows to take addr in.
+        const unsigned long long gap = addr < base_ ? dist(addr, base_) : dist(base_, addr);
+        if (gap >= std::numeric_limits<size_t>::max() / 4) return false;
+        const unsigned long long span = addr < base_ ? gap + dense.size() : gap + 1;
+        if (span > std::numeric_limits<size_t>::max() / 4 || tooSparse(count_ + 1, span)) return false;
+        if (addr < base_){
+            dense.insert(dense.begin(), size_t(dist(addr, base_)), Value());
+            base_ = addr;
+        }
+        else dense.resize(size_t(span));
+        dense[size_t(dist(base_, addr))] = std::move(value);
+        value = Value();
+        ++count_;
+        return true;
+    }
+    // Switches form when the fill ratio has crossed its threshold.
+    void adapt(){
+        if (frozen_ || count_ == 0){
+            if (count_ == 0) clear();
+            return;
+        }
+        if (dense_){
+            if (tooSparse(count_, dense.size())) toSparse();
+        }
+        else {
+            const unsigned long long gap = dist(firsts.front(), leaves.back().back().addr);
+            if (gap < std::numeric_limits<size_t>::max() / 4 && denseEnough(count_, gap + 1)) toDense(gap + 1);
+        }
+    }
+    void toSparse(){
+        std::vector<Value> slots = std::move(dense);
+        const long long base = base_;
+        const size_t n = count_;
+        clear();
+        for (size_t i = 0; i < slots.size(); ++i){
+            if (!slots[i].block()) continue;
+            if (leaves.empty() || leaves.back().size() >= kLeafMax){
+                leaves.emplace_back().reserve(kLeafMax);
+                firsts.push_back(base + (long long)i);
+            }
+            leaves.back().push_back({base + (long long)i, std::move(slots[i])});
+        }
+        count_ = n;
+    }
+    void toDense(unsigned long long span){
+        base_ = firsts.front();
+        dense.assign(size_t(span), Value());
+        for (auto& leaf : leaves)
+            for (auto& e : leaf) dense[size_t(dist(base_, e.addr))] = std::move(e.value);
+        leaves.clear(); firsts.clear();
+        dense_ = true;
+    }
+
+    std::vector<std::vector<Entry>> leaves;  // never holds an empty leaf
+    std::vector<long long> firsts;           // firsts[i] == leaves[i].front().addr
+    size_t count_ = 0;
+    PerfectHash index;                       // frozen: addr -> position in leaves[0]
+    bool frozen_ = false;
+    // Dense form: dense[i] is addr base_ + i, null for a gap; the last slot
+    // is never null.
+    std::vector<Value> dense;
+    long long base_ = 0;
+    bool dense_ = false;
+};
+
+// (reg, addr) -> compiled references of the cells that have any, in (reg,
+// addr) order. A std::map while the bank is edited; freeze() packs it into
+// sorted keys, where each key's tokens start and all tokens back to back,
+// with a PerfectHash over the keys, which takes about half the memory.
+// Modifying a frozen table thaws it first. CellRefs handed out stay valid
+// until the table is modified, frozen or thawed.
+class RefTable {
+public:
+    using Key = std::pair<long long, long long>;
+    struct Item { const Key& first; CellRefs second; };
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Item;
+        using difference_type = std::ptrdiff_t;
+        using reference = Item;
+        struct pointer { Item c; const Item* operator->() const { return &c; } };
+
+        const_iterator() = default;
+        Item operator*() const {
+            if (t->frozen_) return {t->packed.keys[i], t->tokensOf(i)};
+            return {it->first, it->second};
+        }
+        pointer operator->() const { return {**this}; }
+        const_iterator& operator++(){
+            if (t->frozen_) ++i; else ++it;
+            return *this;
+        }
+        const_iterator operator++(int){ auto c = *this; ++*this; return c; }
+        bool operator==(const const_iterator& o) const { return it==o.it && i==o.i; }
+    private:
+        friend class RefTable;
+        using MapIt = std::map<Key, CellIR>::const_iterator;
+        const_iterator(const RefTable* t, MapIt it, size_t i): t(t), it(it), i(i) {}
+        const RefTable* t = nullptr;
+        MapIt it{};
+        size_t i = 0;
+    };
+    using iterator = const_iterator;
+
+    const_iterator begin() const { return {this, frozen_ ? cells.end() : cells.begin(), 0}; }
+    const_iterator end() const { return {this, cells.end(), frozen_ ? packed.keys.size() : 0}; }
+    size_t size() const { return frozen_ ? packed.keys.size() : cells.size(); }
+    bool empty() const { return size() == 0; }
+    bool frozen() const { return frozen_; }
+
+    CellRefs find(long long reg, long long addr) const {
+        const Key k{reg, addr};
+        if (!frozen_){
+            auto it = cells.find(k);
+            return it==cells.end() ? CellRefs{} : CellRefs(it->second);
+        }
+        if (packed.keys.empty()) return {};
+        const size_t i = packed.index.find(hashKey(k));
+        return packed.keys[i]==k ? tokensOf(i) : CellRefs{};
+    }
+    // Empty refs erase the entry.
+    void set(long long reg, long long addr, CellIR refs){
+        thaw();
+        if (refs.empty()) cells.erase({reg, addr});
+        else cells[{reg, addr}] = std::move(refs);
+    }
+    void erase(long long reg, long long addr){
+        if (find(reg, addr).empty()) return;
+        thaw();
+        cells.erase({reg, addr});
+    }
+    void clear(){
+        cells.clear();
+        packed = Packed();
+        frozen_ = false;
+    }
+    // Takes every entry of `later`; its entries win on equal keys.
+    void merge(RefTable&& later){
+        thaw();
+        later.thaw();
+        while (!later.cells.empty()){
+            auto node = later.cells.extract(later.cells.begin());
+            auto pos = cells.insert(cells.end(), std::move(node));
+            if (node) pos->second = std::move(node.mapped());  // repeated cell
+        }
+    }
+
+    void freeze(){
+        if (frozen_) return;
+        size_t n = 0;
+        for (auto& [k, ir] : cells) n += ir.size();
+        if (n > std::numeric_limits<std::uint32_t>::max()) return;
+        Packed& p = packed;
+        p.keys.reserve(cells.size());
+        p.starts.reserve(cells.size() + 1);
+        p.tokens.reserve(n);
+        std::vector<std::uint64_t> hashes;
+        hashes.reserve(cells.size());
+        for (auto& [k, ir] : cells){
+            p.keys.push_back(k);
+            p.starts.push_back((std::uint32_t)p.tokens.size());
+            p.tokens.insert(p.tokens.end(), ir.begin(), ir.end());
+            hashes.push_back(hashKey(k));
+        }
+        p.starts.push_back((std::uint32_t)p.tokens.size());
+        cells.clear();
+        frozen_ = true;
+        if (!p.index.build(hashes)) thaw();
+    }
+    void thaw(){
+        if (!frozen_) return;
+        for (size_t i = 0; i < packed.keys.size(); ++i){
+            CellRefs r = tokensOf(i);
+            cells.emplace_hint(cells.end(), packed.keys[i], CellIR(r.begin(), r.end()));
+        }
+        packed = Packed();
+        frozen_ = false;
+    }
+
+private:
+    static std::uint64_t hashKey(const Key& k){
+        return PerfectHash::mix(std::uint64_t(k.first)) ^ std::uint64_t(k.second);
+    }
+    CellRefs tokensOf(size_t i) const {
+        return {packed.tokens.data() + packed.starts[i], packed.tokens.data() + packed.starts[i+1]};
+    }
+
+    struct Packed {
+        std::vector<Key> keys;
+        std::vector<std::uint32_t> starts;  // keys[i]'s tokens: [starts[i], starts[i+1])
+        std::vector<RefToken> tokens;
+        PerfectHash index;
+    };
+    std::map<Key, CellIR> cells;
+    Packed packed;  // the frozen form
+    bool frozen_ = false;
+};
+
+struct BankLayout;
+
+struct Bank {
+    long long id = 0;
+    string title;
+    // reg -> (addr -> value)
+    std::map<long long, AddrTable> regs;
+    // (reg, addr) -> compiled references; only cells that contain any.
+    // Kept in step with regs by set()/erase(), rebuilt by compile().
+    RefTable ir;
+    unsigned irStampValue = 0;
+    // Where each register sits in the file last loaded or saved, and the
+    // registers changed since; lets a save copy the rest (see
+    // saveContextFile). Null when unknown.
+    std::shared_ptr<const BankLayout> layout;
+    std::set<long long> dirtyRegs;
+    // Where set() puts values, and how much of it edits have orphaned:
+    // bytes of values replaced or erased since the last compactValues().
+    ValueArena values;
+    size_t valueBytes = 0, garbageBytes = 0;
+    // Bumped when values or refs move: compactValues(), freeze(), thaw().
+    unsigned epoch = 0;
+
+    bool empty() const {
+        if (regs.empty()) return true;
+        for (auto& [r, addrs] : regs) if (!addrs.empty()) return false;
+        return true;
+    }
+    const CellValue* find(long long reg, long long addr) const {
+        auto itR = regs.find(reg);
+        if (itR==regs.end()) return nullptr;
+        return itR->second.find(addr);
+    }
+    CellRefs refs(long long reg, long long addr) const { return ir.find(reg, addr); }
+    void set(long long reg, long long addr, std::string_view value, const Config& cfg){
+        thaw();
+        if (irStampValue != irStamp(cfg)) compile(cfg);
+        ir.set(reg, addr, compileCell(value, cfg));
+        valueBytes += value.size();
+        CellValue old = regs[reg].set(addr, CellValue(values, value));
+        if (layout) dirtyRegs.insert(reg);
+        orphan(old.size());
+    }
+    bool erase(long long reg, long long addr){
+        auto itR = regs.find(reg);
+        if (itR==regs.end()) return false;
+        const CellValue* v = itR->second.find(addr);
+        if (!v) return false;
+        const size_t n = v->size();
+        thaw();
+        itR->second.erase(addr);
+        ir.erase(reg, addr);
+        if (layout) dirtyRegs.insert(reg);
+        orphan(n);
+        return true;
+    }
+    // Copies the values only this bank holds into fresh chunks, releasing
+    // the ones edits have mostly emptied. set()/erase() call it once
+    // orphaned bytes outweigh the live ones.
+    void compactValues(){
+        ValueArena fresh;
+        for (auto& [rid, addrs] : regs)
+            addrs.forEachValue([&](long long, CellValue& v){ valuePool().rehome(v, fresh); });
+        values = std::move(fresh);
+        garbageBytes = 0;
+        ++epoch;
+    }
+    void compile(const Config& cfg){
+        const bool wasFrozen = frozen();
+        ir.clear();
+        for (auto& [rid, addrs] : regs)
+            for (const auto& [aid, val] : addrs) ir.set(rid, aid, compileCell(val, cfg));
+        irStampValue = irStamp(cfg);
+        if (wasFrozen) ir.freeze();
+    }
+
+    // Read-only form for reference data: every register and the refs packed
+    // into flat arrays with perfect-hash lookups. Reading and iterating work
+    // as before; set()/erase() thaw the bank back first.
+    void freeze(){
+        if (frozen()) return;
+        for (auto& [rid, addrs] : regs) addrs.freeze();
+        ir.freeze();
+        ++epoch;
+    }
+    void thaw(){
+        if (!frozen()) return;
+        for (auto& [rid, addrs] : regs) addrs.thaw();
+        ir.thaw();
+        ++epoch;
+    }
+    bool frozen() const { return ir.frozen(); }
+
+private:
+    void orphan(size_t n){
+        valueBytes -= std::min(n, valueBytes);
+        garbageBytes += n;
+        if (garbageBytes > std::max(valueBytes, 4 * ValueArena::kChunkSize)) compactValues();
+    }
+};
+
+struct CellKey {
+    long long bank = 0, reg = 0, addr = 0;
+    auto operator<=>(const CellKey&) const = default;
+};
+struct CellKeyHash {
+    size_t operator()(const CellKey& k) const {
+        size_t h = std::hash<long long>{}(k.bank);
+        h = h*1000003u ^ std::hash<long long>{}(k.reg);
+        h = h*1000003u ^ std::hash<long long>{}(k.addr);
+        return h;
+    }
+};
+
+// Fully resolved cell values, kept only for cells whose expansion is the same
+// from any caller: no circular hit and no @file include anywhere below them.
+// Values over kMaxValue bytes are recomputed instead: along a long reference
+// chain every cell's value contains the next one's, so keeping them all
+// would grow with the square of the chain length.
+// deps/rdeps record which cells (or missing keys) each entry was built from,
+// so an edit drops exactly the entries that transitively read the edited key.
+struct ResolveCache {
+    static constexpr size_t kMaxValue = 64 * 1024;
+    unsigned stamp = 0;  // irStamp() of the Config the entries were built with
+    std::unordered_map<CellKey, string, CellKeyHash> values;
+    std::unordered_map<CellKey, std::vector<CellKey>, CellKeyHash> deps;     // entry -> keys it read
+    std::map<CellKey, std::unordered_set<CellKey, CellKeyHash>> rdeps;      // key -> entries reading it
+
+    const string* find(const CellKey& k) const {
+        auto it = values.find(k);
+        return it==values.end() ? nullptr : &it->second;
+    }
+    void put(const CellKey& k, string value, std::vector<CellKey> from){
+        for (auto& d : from) rdeps[d].insert(k);
+        deps[k] = std::move(from);
+        values[k] = std::move(value);
+    }
+    void clear(){ values.clear(); deps.clear(); rdeps.clear(); }
+
+    // k changed: drop its entry and every entry that (transitively) read it.
+    void invalidate(const CellKey& k){
+        std::vector<CellKey> work{k};
+        while (!work.empty()){
+            CellKey c = work.back(); work.pop_back();
+            values.erase(c);
+            if (auto it = deps.find(c); it != deps.end()){
+                for (auto& d : it->second){
+                    auto r = rdeps.find(d);
+                    if (r==rdeps.end()) continue;
+                    r->second.erase(c);
+                    if (r->second.empty()) rdeps.erase(r);
+                }
+                deps.erase(it);
+            }
+            auto r = rdeps.find(c);
+            if (r==rdeps.end()) continue;
+            for (auto& u : r->second) work.push_back(u);
+            rdeps.erase(r);
+        }
+    }
+    // Bank appeared or was replaced: everything that read one of its keys is
+    // stale. With dropOwn, entries for the bank's own cells go too.
+    void invalidateBank(long long bank, bool dropOwn){
+        std::vector<CellKey> keys;
+        for (auto it = rdeps.lower_bound({bank, std::numeric_limits<long long>::min(), std::numeric_limits<long long>::min()});
+             it != rdeps.end() && it->first.bank == bank; ++it)
+            keys.push_back(it->first);
+        if (dropOwn)
+            for (auto& [k, v] : values) if (k.bank == bank) keys.push_back(k);
+        for (auto& k : keys) invalidate(k);
+    }
+};
+
+// Reverse references: for every key, the loaded cells whose IR points at it
+// (two-part refs count as register 1). References that only appear inside
+// @file includes are not indexed.
+struct RefIndex {
+    unsigned stamp = 0;  // irStamp() the indexed IR was compiled with
+    std::unordered_map<CellKey, std::unordered_set<CellKey, CellKeyHash>, CellKeyHash> users;
+
+    const std::unordered_set<CellKey, CellKeyHash>* find(const CellKey& k) const {
+        auto it = users.find(k);
+        return it==users.end() ? nullptr : &it->second;
+    }
+    void add(const CellKey& from, CellRefs ir){
+        for (auto& t : ir)
+            if (t.kind==RefToken::Three || t.kind==RefToken::Two)
+                users[{t.bank, t.reg, t.addr}].insert(from);
+    }
+    void remove(const CellKey& from, CellRefs ir){
+        for (auto& t : ir){
+            if (t.kind!=RefToken::Three && t.kind!=RefToken::Two) continue;
+            auto it = users.find({t.bank, t.reg, t.addr});
+            if (it==users.end()) continue;
+            it->second.erase(from);
+            if (it->second.empty()) users.erase(it);
+        }
+    }
+    void addBank(long long id, const Bank& b){
+        for (const auto& [ra, ir] : b.ir) add({id, ra.first, ra.second}, ir);
+    }
+    void removeBank(long long id, const Bank& b){
+        for (const auto& [ra, ir] : b.ir) remove({id, ra.first, ra.second}, ir);
+    }
+};
+
+// Cells on a reference cycle (strongly connected components of the graph
+// of compiled references across loaded banks, plus self-references). A
+// reference to one of them resolves to [Circular Ref] without walking the
+// loop. Edits and bank loads make the analysis stale; see analyzeCycles().
+struct CycleIndex {
+    unsigned stamp = 0;  // irStamp() the analysis was built with; 0 when stale
+    std::unordered_set<CellKey, CellKeyHash> cyclic;
+    std::vector<std::vector<CellKey>> components;  // each sorted, ordered by first cell
+
+    bool onCycle(unsigned want, const CellKey& k) const { return stamp==want && cyclic.count(k); }
+};
+
+// Every cell of the loaded banks by packed (bank, reg, addr) key, in flat
+// open-addressing tables, so the Resolver finds a value and its compiled
+// references with one probe instead of three tree lookups. The narrow
+// table packs the ids into 64 bits, giving bank and register as many bits
+// as widthBank/widthReg digits need and the rest to the address; a cell
+// whose ids do not fit there goes to the wide table (bank in 64 bits,
+// register in 24, address in 40). Cells with negative or larger ids are
+// only in their banks. Entries point into the banks, so every change to a
+// loaded bank goes through indexBank/unindexBank/setCell/eraseCell.
+class CellIndex {
+public:
+    struct Hit {
+        const ValueBlock* value = nullptr;  // null: free slot
+        CellRefs refs;
+    };
+
+    // Built for this Config?
+    bool ready(const Config& cfg) const {
+        return stamp == irStamp(cfg) && base == cfg.base && widthBank == cfg.widthBank && widthReg == cfg.widthReg;
+    }
+    void reset(const Config& cfg){
+        narrow.clear(); wide.clear();
+        stamp = irStamp(cfg); base = cfg.base; widthBank = cfg.widthBank; widthReg = cfg.widthReg;
+        bankBits = digitBits(cfg.base, cfg.widthBank);
+        regBits = digitBits(cfg.base, cfg.widthReg);
+        addrBits = bankBits + regBits < 64 ? 64 - bankBits - regBits : 0;
+    }
+    size_t size() const { return narrow.size() + wide.size(); }
+
+    const Hit* find(long long bank, long long reg, long long addr) const {
+        std::uint64_t k;
+        if (packNarrow(bank, reg, addr, k)) return narrow.find(k);
+        Key128 w;
+        if (packWide(bank, reg, addr, w)) return wide.find(w);
+        return nullptr;
+    }
+    void put(long long bank, long long reg, long long addr, const CellValue& v, CellRefs refs){
+        std::uint64_t k;
+        Key128 w;
+        if (packNarrow(bank, reg, addr, k)) narrow.put(k, {v.block(), refs});
+        else if (packWide(bank, reg, addr, w)) wide.put(w, {v.block(), refs});
+    }
+    void erase(long long bank, long long reg, long long addr){
+        std::uint64_t k;
+        Key128 w;
+        if (packNarrow(bank, reg, addr, k)) narrow.erase(k);
+        else if (packWide(bank, reg, addr, w)) wide.erase(w);
+    }
+    // b must be compiled; its cells and b.ir are both in (reg, addr) order.
+    void addBank(long long id, const Bank& b){
+        size_t n = 0;
+        for (auto& [rid, addrs] : b.regs) n += addrs.size();
+        narrow.reserve(narrow.size() + n);
+        refreshBank(id, b);
+    }
+    // Bank id is indexed already, but its values or refs moved.
+    void refreshBank(long long id, const Bank& b){
+        auto ir = b.ir.begin();
+        for (auto& [rid, addrs] : b.regs)
+            for (const auto& [aid, val] : addrs){
+                const std::pair<long long, long long> ra{rid, aid};
+                while (ir != b.ir.end() && ir->first < ra) ++ir;
+                put(id, rid, aid, val, ir != b.ir.end() && ir->first == ra ? ir->second : CellRefs{});
+            }
+    }
+    void removeBank(long long id, const Bank& b){
+        for (auto& [rid, addrs] : b.regs)
+            for (const auto& [aid, val] : addrs) erase(id, rid, aid);
+    }
+
+private:
+    struct Key128 {
+        std::uint64_t hi, lo;
+        bool operator==(const Key128&) const = default;
+    };
+    static std::uint64_t mix(std::uint64_t x){
+        x ^= x >> 33; x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ull;
+        return x ^ (x >> 33);
+    }
+    static std::uint64_t hashKey(std::uint64_t k){ return mix(k); }
+    static std::uint64_t hashKey(const Key128& k){ return mix(k.hi ^ mix(k.lo)); }
+
+    // Linear probing, backward-shift deletion, at most 3/4 full.
+    template<class Key>
+    class Table {
+    public:
+        size_t size() const { return used; }
+        void clear(){ slots.clear(); used = 0; }
+        void reserve(size_t n){
+            size_t cap = std::max<size_t>(64, slots.size());
+            while (n * 4 > cap * 3) cap *= 2;
+            if (cap != slots.size()) grow(cap);
+        }
+        const Hit* find(const Key& k) const {
+            if (slots.empty()) return nullptr;
+            const size_t mask = slots.size() - 1;
+            for (size_t i = hashKey(k) & mask; slots[i].hit.value; i = (i + 1) & mask)
+                if (slots[i].key == k) return &slots[i].hit;
+            return nullptr;
+        }
+        void put(const Key& k, const Hit& h){
+            if ((used + 1) * 4 > slots.size() * 3) grow(std::max<size_t>(64, slots.size() * 2));
+            const size_t mask = slots.size() - 1;
+            size_t i = hashKey(k) & mask;
+            for (; slots[i].hit.value; i = (i + 1) & mask)
+                if (slots[i].key == k){ slots[i].hit = h; return; }
+            slots[i] = {k, h};
+            ++used;
+        }
+        void erase(const Key& k){
+            if (slots.empty()) return;
+            const size_t mask = slots.size() - 1;
+            size_t i = hashKey(k) & mask;
+            for (; slots[i].hit.value; i = (i + 1) & mask)
+                if (slots[i].key == k) break;
+            if (!slots[i].hit.value) return;
+            --used;
+            for (size_t j = (i + 1) & mask; slots[j].hit.value; j = (j + 1) & mask){
+                const size_t home = hashKey(slots[j].key) & mask;
+                const bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+                if (!stays){ slots[i] = slots[j]; i = j; }
+            }
+            slots[i] = {};
+        }
+    private:
+        struct Slot { Key key{}; Hit hit; };
+        void grow(size_t cap){
+            std::vector<Slot> old(cap);
+            old.swap(slots);
+            const size_t mask = slots.size() - 1;
+            for (const Slot& s : old){
+                if (!s.hit.value) continue;
+                size_t i = hashKey(s.key) & mask;
+                while (slots[i].hit.value) i = (i + 1) & mask;
+                slots[i] = s;
+            }
+        }
+        std::vector<Slot> slots;
+        size_t used = 0;
+    };
+
+    // Bits for ids of up to `width` digits in `base` (64: no room).
+    static unsigned digitBits(int base, int width){
+        if (base < 2) return 64;
+        std::uint64_t limit = 1;
+        for (int i = 0; i < width; ++i){
+            if (limit > (std::uint64_t(1) << 62) / std::uint64_t(base)) return 64;
+            limit *= std::uint64_t(base);
+        }
+        return std::max(1u, (unsigned)std::bit_width(limit - 1));
+    }
+    static bool fits(long long v, unsigned bits){ return v >= 0 && (bits >= 63 || (unsigned long long)v < (1ull << bits)); }
+    bool packNarrow(long long bank, long long reg, long long addr, std::uint64_t& k) const {
+        if (!addrBits || !fits(bank, bankBits) || !fits(reg, regBits) || !fits(addr, addrBits)) return false;
+        k = (std::uint64_t(bank) << (regBits + addrBits)) | (std::uint64_t(reg) << addrBits) | std::uint64_t(addr);
+        return true;
+    }
+    static bool packWide(long long bank, long long reg, long long addr, Key128& k){
+        if (bank < 0 || !fits(reg, 24) || !fits(addr, 40)) return false;
+        k = {std::uint64_t(bank), (std::uint64_t(reg) << 40) | std::uint64_t(addr)};
+        return true;
+    }
+
+    unsigned stamp = 0;  // irStamp() the entries' refs were compiled with; 0: never built
+    int base = 0, widthBank = 0, widthReg = 0;
+    unsigned bankBits = 0, regBits = 0, addrBits = 0;
+    Table<std::uint64_t> narrow;
+    Table<Key128> wide;
+};
+
+// What identifies one version of a file on disk. Rewrites through
+// saveContextFile (temp file + rename) change the inode even when mtime and
+// size happen to match.
+struct FileStamp {
+    long long mtimeNs = 0;
+    unsigned long long size = 0;
+    unsigned long long inode = 0;  // 0 where the platform has none
+    bool operator==(const FileStamp&) const = default;
+};
+
+class CompiledBank;
+
+// What coldBank() found for a bank: its .bankc, or null when there is none
+// to use, and the text and .bankc files as they were then.
+struct ColdBank {
+    std::shared_ptr<CompiledBank> bank;
+    FileStamp text, compiled;
+};
+
+class Journal;
+
+struct Workspace {
+    std::map<long long, Bank> banks;       // id -> Bank
+    std::map<long long, string> filenames; // id -> path
+    ResolveCache cache;
+    RefIndex refs;
+    CycleIndex cycles;
+    CellIndex cells;
+    std::map<long long, ColdBank> compiled;                       // see coldBank()
+    std::map<long long, std::shared_ptr<Journal>> journals;       // see journalFor()
+};
+
+// Bring ws.refs and ws.cells up to date after bank `id` was (re)loaded. A
+// prefix/base change since the index was built means recompiling and
+// reindexing everything; a widths change, rebuilding ws.cells.
+inline void indexBank(const Config& cfg, Workspace& ws, long long id){
+    ws.cycles.stamp = 0;
+    if (ws.refs.stamp != irStamp(cfg) || !ws.cells.ready(cfg)){
+        ws.refs = {};
+        ws.refs.stamp = irStamp(cfg);
+        ws.cells.reset(cfg);
+        for (auto& [bid, b] : ws.banks){
+            if (b.irStampValue != ws.refs.stamp) b.compile(cfg);
+            ws.refs.addBank(bid, b);
+            ws.cells.addBank(bid, b);
+        }
+        return;
+    }
+    auto& b = ws.banks[id];
+    if (b.irStampValue != ws.refs.stamp) b.compile(cfg);
+    ws.refs.addBank(id, b);
+    ws.cells.addBank(id, b);
+}
+// Call before a loaded bank is replaced or dropped.
+inline void unindexBank(Workspace& ws, long long id){
+    ws.cycles.stamp = 0;
+    auto it = ws.banks.find(id);
+    if (it!=ws.banks.end() && it->second.irStampValue==ws.refs.stamp){
+        ws.refs.removeBank(id, it->second);
+        ws.cells.removeBank(id, it->second);
+    }
+}
+
+// Packs loaded bank `id` read-only (see Bank::freeze); the next setCell or
+// eraseCell on it thaws it.
+inline void freezeBank(const Config& cfg, Workspace& ws, long long id){
+    auto it = ws.banks.find(id);
+    if (it==ws.banks.end()) return;
+    Bank& b = it->second;
+    if (b.irStampValue != irStamp(cfg)) b.compile(cfg);
+    b.freeze();
+    if (ws.cells.ready(cfg)) ws.cells.refreshBank(id, b);
+}
+
+// ws.cells after an edit of (bank, reg, addr) in b; everything of b when the
+// edit moved its values or refs (see Bank::epoch).
+inline void reindexCell(const Config& cfg, Workspace& ws, long long bank, const Bank& b,
+                        long long reg, long long addr, unsigned epochBefore){
+    if (!ws.cells.ready(cfg) || b.irStampValue != irStamp(cfg)) return;
+    if (b.epoch != epochBefore) ws.cells.refreshBank(bank, b);
+    if (const CellValue* v = b.find(reg, addr)) ws.cells.put(bank, reg, addr, *v, b.refs(reg, addr));
+    else ws.cells.erase(bank, reg, addr);
+}
+
+inline Journal* journalFor(const Config& cfg, Workspace& ws, long long bank);
+inline bool journalSet(const Config& cfg, Journal& j, long long reg, long long addr, std::string_view value);
+inline bool journalErase(const Config& cfg, Journal& j, long long reg, long long addr);
+
+// setCell without the journal.
+inline void storeCell(const Config& cfg, Workspace& ws, long long bank, long long reg, long long addr, std::string_view value){
+    auto& b = ws.banks[bank];
+    if (b.irStampValue == ws.refs.stamp) ws.refs.remove({bank, reg, addr}, b.refs(reg, addr));
+    const unsigned epoch = b.epoch;
+    b.set(reg, addr, value, cfg);
+    reindexCell(cfg, ws, bank, b, reg, addr, epoch);
+    if (ws.refs.stamp == irStamp(cfg)) ws.refs.add({bank, reg, addr}, b.refs(reg, addr));
+    ws.cache.invalidate({bank, reg, addr});
+    ws.cycles.stamp = 0;
+}
+
+// Edits that keep the workspace caches coherent; use these rather than Bank::set/erase
+// on banks that live in a Workspace. With cfg.journal they are logged first;
+// *journaled tells whether that worked (the edit is made either way, and one
+// that is not journaled is only in memory until the bank is saved).
+inline void setCell(const Config& cfg, Workspace& ws, long long bank, long long reg, long long addr, std::string_view value,
+                    bool* journaled = nullptr){
+    bool logged = false;
+    if (Journal* j = journalFor(cfg, ws, bank)) logged = journalSet(cfg, *j, reg, addr, value);
+    if (journaled) *journaled = logged;
+    storeCell(cfg, ws, bank, reg, addr, value);
+}
+inline bool eraseCell(const Config& cfg, Workspace& ws, long long bank, long long reg, long long addr,
+                      bool* journaled = nullptr){
+    if (journaled) *journaled = false;
+    auto& b = ws.banks[bank];
+    if (!b.find(reg, addr)) return false;
+    if (Journal* j = journalFor(cfg, ws, bank)){
+        const bool logged = journalErase(cfg, *j, reg, addr);
+        if (journaled) *journaled = logged;
+    }
+    if (b.irStampValue == ws.refs.stamp) ws.refs.remove({bank, reg, addr}, b.refs(reg, addr));
+    const unsigned epoch = b.epoch;
+    if (!b.erase(reg, addr)) return false;
+    reindexCell(cfg, ws, bank, b, reg, addr, epoch);
+    ws.cache.invalidate({bank, reg, addr});
+    ws.cycles.stamp = 0;
+    return true;
+}
+
+// Cells referencing (bank, reg, addr), sorted.
+inline std::vector<CellKey> findReferences(const Config& cfg, Workspace& ws, long long bank, long long reg, long long addr){
+    if (ws.refs.stamp != irStamp(cfg)) indexBank(cfg, ws, bank);
+    std::vector<CellKey> out;
+    if (auto* u = ws.refs.find({bank, reg, addr})) out.assign(u->begin(), u->end());
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Rebuilds ws.cycles if stale: Tarjan's algorithm, iterative, over the cells
+// that hold references (no other cell can be on a cycle).
+inline const CycleIndex& analyzeCycles(const Config& cfg, Workspace& ws){
+    const unsigned want = irStamp(cfg);
+    if (ws.cycles.stamp == want) return ws.cycles;
+    std::vector<CellKey> nodes;
+    std::unordered_map<CellKey, unsigned, CellKeyHash> idOf;
+    for (auto& [bid, b] : ws.banks){
+        if (b.irStampValue != want) b.compile(cfg);
+        for (const auto& [ra, ir] : b.ir){
+            CellKey k{bid, ra.first, ra.second};
+            idOf.emplace(k, (unsigned)nodes.size());
+            nodes.push_back(k);
+        }
+    }
+    const unsigned n = (unsigned)nodes.size();
+    std::vector<std::vector<unsigned>> adj(n);
+    for (unsigned v=0; v<n; ++v){
+        const CellKey& k = nodes[v];
+        for (auto& t : ws.banks.find(k.bank)->second.refs(k.reg, k.addr)){
+            if (t.kind!=RefToken::Three && t.kind!=RefToken::Two) continue;
+            auto it = idOf.find({t.bank, t.reg, t.addr});
+            if (it!=idOf.end()) adj[v].push_back(it->second);
+        }
+    }
+
+    CycleIndex ci;
+    const unsigned unseen = ~0u;
+    std::vector<unsigned> index(n, unseen), low(n), open;
+    std::vector<char> onOpen(n, 0);
+    struct Visit { unsigned v; size_t edge; };
+    std::vector<Visit> calls;
+    unsigned counter = 0;
+    auto enter = [&](unsigned v){
+        index[v] = low[v] = counter++;
+        open.push_back(v); onOpen[v] = 1;
+        calls.push_back({v, 0});
+    };
+    for (unsigned root=0; root<n; ++root){
+        if (index[root] != unseen) continue;
+        enter(root);
+        while (!calls.empty()){
+            const unsigned v = calls.back().v;
+            if (calls.back().edge < adj[v].size()){
+                unsigned w = adj[v][calls.back().edge++];
+                if (index[w] == unseen) enter(w);
+                else if (onOpen[w]) low[v] = std::min(low[v], index[w]);
+                continue;
+            }
+            calls.pop_back();
+            if (!calls.empty()) low[calls.back().v] = std::min(low[calls.back().v], low[v]);
+            if (low[v] != index[v]) continue;
+            std::vector<CellKey> comp;
+            unsigned w;
+            do {
+                w = open.back(); open.pop_back(); onOpen[w] = 0;
+                comp.push_back(nodes[w]);
+            } while (w != v);
+            if (comp.size()==1 && std::find(adj[v].begin(), adj[v].end(), v)==adj[v].end()) continue;
+            std::sort(comp.begin(), comp.end());
+            ci.cyclic.insert(comp.begin(), comp.end());
+            ci.components.push_back(std::move(comp));
+        }
+    }
+    std::sort(ci.components.begin(), ci.components.end());
+    ci.stamp = want;
+    ws.cycles = std::move(ci);
+    return ws.cycles;
+}
+
+// ----------------------------- Work-stealing thread pool -----------------------------
+// Each worker owns a deque: it pops its own work LIFO and, when empty, steals
+// FIFO from the others. submit() spreads tasks round-robin; wait() blocks
+// until everything submitted so far has run and rethrows the first exception.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads){
+        if (threads==0) threads = 1;
+        for (unsigned i=0; i<threads; ++i) queues.push_back(std::make_unique<Queue>());
+        for (unsigned i=0; i<threads; ++i) workers.emplace_back([this,i]{ run(i); });
+    }
+    ~WorkStealingPool(){
+        { std::lock_guard lk(mu); stop = true; }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    void submit(std::function<void()> task){
+        unsigned q = next.fetch_add(1) % (unsigned)queues.size();
+        { std::lock_guard lk(queues[q]->mu); queues[q]->tasks.push_back(std::move(task)); }
+        { std::lock_guard lk(mu); ++queued; ++pending; }
+        wake.notify_one();
+    }
+    void wait(){
+        std::unique_lock lk(mu);
+        done.wait(lk, [this]{ return pending==0; });
+        if (error){ auto e = error; error = nullptr; std::rethrow_exception(e); }
+    }
+
+private:
+    struct Queue { std::mutex mu; std::deque<std::function<void()>> tasks; };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex mu;
+    std::condition_variable wake, done;
+    size_t queued = 0, pending = 0;  // guarded by mu
+    bool stop = false;
+    std::exception_ptr error;
+    std::atomic<unsigned> next{0};
+
+    bool take(unsigned self, std::function<void()>& task){
+        {   auto& q = *queues[self];
+            std::lock_guard lk(q.mu);
+            if (!q.tasks.empty()){ task = std::move(q.tasks.back()); q.tasks.pop_back(); return true; }
+        }
+        for (size_t k=1; k<queues.size(); ++k){
+            auto& q = *queues[(self+k) % queues.size()];
+            std::lock_guard lk(q.mu);
+            if (!q.tasks.empty()){ task = std::move(q.tasks.front()); q.tasks.pop_front(); return true; }
+        }
+        return false;
+    }
+    void run(unsigned self){
+        for (;;){
+            std::function<void()> task;
+            if (take(self, task)){
+                { std::lock_guard lk(mu); --queued; }
+                std::exception_ptr err;
+                try { task(); } catch (...) { err = std::current_exception(); }
+                std::lock_guard lk(mu);
+                if (err && !error) error = err;
+                if (--pending==0) done.notify_all();
+                continue;
+            }
+            std::unique_lock lk(mu);
+            wake.wait(lk, [this]{ return stop || queued>0; });
+            if (stop && queued==0) return;
+        }
+    }
+};
+
+inline unsigned defaultJobs(){
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// ----------------------------- Byte scanning kernels -----------------------------
+// The parser's hot loop looks for the end of a line and for the '}' that ends
+// a bank body. findEither() finds the first of two bytes 16 (SSE2) or 32
+// (AVX2) bytes at a time; the kernel is picked once from what the CPU
+// supports, with a byte-at-a-time fallback elsewhere. Kernels return the
+// index of the first match, or n.
+using FindEitherFn = size_t (*)(const char* p, size_t n, char a, char b);
+
+inline size_t findEitherScalar(const char* p, size_t n, char a, char b){
+    size_t i = 0;
+    while (i < n && p[i]!=a && p[i]!=b) ++i;
+    return i;
+}
+
+#if defined(SCRIPTED_X86)
+inline size_t findEitherSSE2(const char* p, size_t n, char a, char b){
+    const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16){
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+        if (m) return i + (size_t)std::countr_zero(m);
+    }
+    return i + findEitherScalar(p + i, n - i, a, b);
+}
+
+SCRIPTED_TARGET_AVX2 inline size_t findEitherAVX2(const char* p, size_t n, char a, char b){
+    const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32){
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)));
+        if (m) return i + (size_t)std::countr_zero(m);
+    }
+    return i + findEitherSSE2(p + i, n - i, a, b);
+}
+#endif
+
+enum class ScanKernel { Scalar, SSE2, AVX2 };
+
+inline const char* scanKernelName(ScanKernel k){
+    switch (k){
+    case ScanKernel::SSE2: return "sse2";
+    case ScanKernel::AVX2: return "avx2";
+    default:               return "scalar";
+    }
+}
+
+inline bool scanKernelSupported(ScanKernel k){
+    if (k==ScanKernel::Scalar) return true;
+#if defined(SCRIPTED_X86)
+    #if defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 1);
+    if (k==ScanKernel::SSE2) return (r[3] >> 26) & 1;
+    const bool osAvx = ((r[2] >> 27) & 1) && ((r[2] >> 28) & 1) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(r, 7, 0);
+    return osAvx && ((r[1] >> 5) & 1);
+    #else
+    __builtin_cpu_init();
+    if (k==ScanKernel::SSE2) return __builtin_cpu_supports("sse2");
+    return __builtin_cpu_supports("avx2");
+    #endif
+#else
+    return false;
+#endif
+}
+
+inline FindEitherFn scanKernelFn(ScanKernel k){
+#if defined(SCRIPTED_X86)
+    if (k==ScanKernel::AVX2) return findEitherAVX2;
+    if (k==ScanKernel::SSE2) return findEitherSSE2;
+#endif
+    (void)k;
+    return findEitherScalar;
+}
+
+inline ScanKernel bestScanKernel(){
+    for (ScanKernel k : {ScanKernel::AVX2, ScanKernel::SSE2})
+        if (scanKernelSupported(k)) return k;
+    return ScanKernel::Scalar;
+}
+
+inline std::atomic<FindEitherFn>& findEitherSlot(){
+    static std::atomic<FindEitherFn> fn{scanKernelFn(bestScanKernel())};
+    return fn;
+}
+// Overrides the kernel, e.g. to benchmark one against another; an
+// unsupported choice falls back to scalar.
+inline void useScanKernel(ScanKernel k){
+    findEitherSlot().store(scanKernelFn(scanKernelSupported(k) ? k : ScanKernel::Scalar), std::memory_order_relaxed);
+}
+
+inline size_t findEither(const char* p, size_t n, char a, char b){
+    return findEitherSlot().load(std::memory_order_relaxed)(p, n, a, b);
+}
+
+// ----------------------------- Memory-mapped files -----------------------------
+inline bool statFile(const fs::path& p, FileStamp& out){
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct stat st;
+    if (::stat(p.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+  #if defined(__APPLE__)
+    out.mtimeNs = (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+  #else
+    out.mtimeNs = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  #endif
+    out.size = (unsigned long long)st.st_size;
+    out.inode = (unsigned long long)st.st_ino;
+    return true;
+#else
+    std::error_code ec;
+    if (!fs::is_regular_file(p, ec)) return false;
+    auto t = fs::last_write_time(p, ec);
+    if (ec) return false;
+    out.mtimeNs = (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+    out.size = (unsigned long long)fs::file_size(p, ec);
+    out.inode = 0;
+    return !ec;
+#endif
+}
+
+// Read-only view of a whole file. POSIX maps it; elsewhere it is read into
+// memory. The view stays valid for the object's lifetime (as long as nobody
+// truncates the file in place).
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& o) noexcept { *this = std::move(o); }
+    MappedFile& operator=(MappedFile&& o) noexcept {
+        if (this != &o){
+            reset();
+            ptr = o.ptr; len = o.len; mapped = o.mapped; buf = std::move(o.buf);
+            if (!mapped) ptr = buf.data();
+            o.ptr = nullptr; o.len = 0; o.mapped = false;
+        }
+        return *this;
+    }
+    ~MappedFile(){ reset(); }
+
+    bool open(const fs::path& p, string& err){
+        reset();
+#if !defined(_WIN32) && !defined(_WIN64)
+        int fd = ::open(p.c_str(), O_RDONLY);
+        if (fd < 0){ err = "cannot open: " + p.string(); return false; }
+        struct stat st;
+        if (::fstat(fd, &st) != 0){ ::close(fd); err = "cannot stat: " + p.string(); return false; }
+        len = (size_t)st.st_size;
+        if (len > 0){
+            void* m = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED){ ::close(fd); len = 0; err = "cannot map: " + p.string(); return false; }
+            ptr = static_cast<const char*>(m);
+            mapped = true;
+        }
+        ::close(fd);
+        return true;
+#else
+        std::ifstream in(p, std::ios::binary);
+        if (!in){ err = "cannot open: " + p.string(); return false; }
+        buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        ptr = buf.data(); len = buf.size();
+        return true;
+#endif
+    }
+    void reset(){
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (mapped) ::munmap(const_cast<char*>(ptr), len);
+#endif
+        ptr = nullptr; len = 0; mapped = false; buf.clear();
+    }
+    std::string_view view() const { return {ptr ? ptr : "", len}; }
+    size_t size() const { return len; }
+
+private:
+    const char* ptr = nullptr;
+    size_t len = 0;
+    bool mapped = false;
+    string buf;
+};
+
+// ----------------------------- Parsing & I/O -----------------------------
+struct ParseResult { bool ok=true; string err; };
+
+inline std::string_view trimView(std::string_view s){
+    auto space = [](char c){ return std::isspace((unsigned char)c) != 0; };
+    while (!s.empty() && space(s.front())) s.remove_prefix(1);
+    while (!s.empty() && space(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+// Lines of an in-memory text as std::getline splits them: on '\n', with no
+// empty last line. Views into the text.
+struct ViewLines {
+    explicit ViewLines(std::string_view text): text(text) {}
+    std::string_view text;
+    size_t pos = 0;
+    bool brace = false;  // the last line held '}'
+    string error;        // never set; same shape as FdLines
+    bool next(std::string_view& line){
+        if (pos >= text.size()) return false;
+        size_t e = pos + findEither(text.data() + pos, text.size() - pos, '\n', '}');
+        brace = e < text.size() && text[e]=='}';
+        if (brace) e = std::min(text.find('\n', e), text.size());
+        line = text.substr(pos, e - pos);
+        pos = e + 1;
+        return true;
+    }
+};
+
+// The same lines pulled from a file descriptor through a fixed-size buffer.
+// Memory stays at the buffer plus the longest line; a line is valid until
+// the next call.
+class FdLines {
+public:
+    string error;
+    bool brace = false;  // the last line held '}'
+    explicit FdLines(int fd, size_t bufSize = 64 * 1024): fd(fd), buf(std::max<size_t>(bufSize, 16)) {}
+    bool next(std::string_view& line){
+        if (carryOut){ carry.clear(); carryOut = false; }
+        brace = false;
+        for (;;){
+            const char* b = buf.data() + begin;
+            const size_t n = end - begin;
+            size_t len = findEither(b, n, '\n', '}');
+            while (len < n && b[len]=='}'){
+                brace = true;
+                len += 1 + findEither(b + len + 1, n - len - 1, '\n', '}');
+            }
+            if (len < n){
+                begin += len + 1;
+                if (carry.empty()){ line = {b, len}; return true; }
+                carry.append(b, len);
+                line = carry; carryOut = true;
+                return true;
+            }
+            carry.append(b, n);
+            begin = end = 0;
+            if (eof){
+                if (carry.empty()) return false;
+                line = carry; carryOut = true;
+                return true;
+            }
+            long got = readSome(buf.data(), buf.size());
+            if (got < 0){ error = "read failed"; return false; }
+            if (got == 0) eof = true;
+            else end = size_t(got);
+        }
+    }
+
+private:
+    long readSome(char* p, size_t n){
+#if !defined(_WIN32) && !defined(_WIN64)
+        for (;;){
+            ssize_t got = ::read(fd, p, n);
+            if (got < 0 && errno == EINTR) continue;
+            return (long)got;
+        }
+#else
+        return (long)::_read(fd, p, (unsigned)std::min<size_t>(n, 1u << 30));
+#endif
+    }
+    int fd;
+    std::vector<char> buf;
+    size_t begin = 0, end = 0;
+    bool eof = false;
+    string carry;        // a line that straddles refills
+    bool carryOut = false;
+};
+
+// Reads a bank from any source of lines in one forward pass: header() up to
+// and including the line with '{', then next() for each cell until '}' or
+// the end. Views in a Record point into the current line.
+template<class Lines>
+class BankRecordReader {
+public:
+    struct Record { long long reg, addr; std::string_view value; };
+    long long id = 0;
+    string title;
+
+    BankRecordReader(Lines& src, const Config& cfg): src(src), cfg(cfg) {}
+
+    ParseResult header(){
+        std::string_view line;
+        bool any = false;
+        do {
+            if (!src.next(line)) return fail(any ? "no header found" : "empty file");
+            any = true;
+        } while (trimView(line).empty());
+
+        std::string_view header = trimView(line);
+        string headerAccum;  // only built when the header spans lines
+        if (header.find('{')==std::string_view::npos){
+            headerAccum.assign(header);
+            while (headerAccum.find('{')==string::npos && src.next(line)){
+                headerAccum += ' ';
+                headerAccum.append(trimView(line));
+            }
+            header = headerAccum;
+        }
+        if (header.find('{')==std::string_view::npos) return fail("missing '{' after header");
+
+        size_t lp = header.find('(');
+        size_t rp = header.rfind(')');
+        if (lp==std::string_view::npos || rp==std::string_view::npos || rp<lp) return fail("malformed header: parentheses");
+        std::string_view left = trimView(header.substr(0, lp));
+        title = string(trimView(header.substr(lp+1, rp-lp-1)));
+
+        if (!left.empty() && left[0]==cfg.prefix) left.remove_prefix(1);
+        if (!parseIntBase(left, cfg.base, id)) return fail("cannot parse bank id");
+        return {};
+    }
+
+    // False at the end of the body; result() then says whether that was an error.
+    bool next(Record& r){
+        std::string_view line;
+        while (!done && src.next(line)){
+            if (src.brace) break;
+            std::string_view s = trimView(line);
+            if (s.empty()) continue;
+
+            if (line[0] != '\t'){
+                long long regId;
+                if (!parseIntBase(s, cfg.base, regId)){
+                    fail("invalid register line: " + string(s));
+                    return false;
+                }
+                currentReg = regId;
+                continue;
+            }
+            std::string_view t = line.substr(std::min(line.size(), line.find_first_not_of("\t ")));
+            size_t sep = t.find('\t');
+            if (sep==std::string_view::npos) sep = t.find(' ');
+            std::string_view addrTok, val;
+            if (sep==std::string_view::npos) addrTok = trimView(t);
+            else { addrTok = trimView(t.substr(0, sep)); val = t.substr(sep+1); }
+
+            long long addrId;
+            if (!parseIntBase(addrTok, cfg.base, addrId)){
+                fail("invalid address id: " + string(addrTok));
+                return false;
+            }
+            r = {currentReg, addrId, val};
+            return true;
+        }
+        if (!done && !src.error.empty()) fail(src.error);
+        done = true;
+        return false;
+    }
+    const ParseResult& result() const { return res; }
+
+private:
+    ParseResult fail(string e){
+        if (res.ok){
+            res = {false, src.error.empty() ? std::move(e) : src.error};
+        }
+        done = true;
+        return res;
+    }
+    Lines& src;
+    const Config& cfg;
+    long long currentReg = 1;
+    bool done = false;
+    ParseResult res;
+};
+
+// Parses a bank in place: lines and fields are views into text, which may be
+// a mapped file; only the title and the cell values are copied out.
+inline ParseResult parseBankText(std::string_view text, const Config& cfg, Bank& outBank) {
+    ViewLines lines{text};
+    BankRecordReader<ViewLines> rd(lines, cfg);
+    if (ParseResult pr = rd.header(); !pr.ok) return pr;
+    outBank = {};
+    outBank.id = rd.id;
+    outBank.title = std::move(rd.title);
+    outBank.irStampValue = irStamp(cfg);
+    BankRecordReader<ViewLines>::Record r;
+    while (rd.next(r)) outBank.set(r.reg, r.addr, r.value, cfg);
+    return rd.result();
+}
+
+// parseBankText on several threads, for big banks. Register lines are the
+// only body lines without a leading tab, so the body is cut at them into
+// chunks of at least kParallelParseChunk bytes that parse on their own.
+// Chunks are merged in file order: a repeated cell keeps its last value and
+// an error leaves the same partial bank as the sequential parse.
+constexpr size_t kParallelParseChunk = 1 << 20;
+
+inline ParseResult parseBankTextParallel(std::string_view text, const Config& cfg, Bank& outBank, unsigned jobs){
+    ViewLines head{text};
+    BankRecordReader<ViewLines> rd(head, cfg);
+    if (ParseResult pr = rd.header(); !pr.ok) return pr;
+
+    // The body runs to the first line holding '}'.
+    const size_t begin = std::min(head.pos, text.size());
+    size_t end = text.find('}', begin);
+    if (end==std::string_view::npos) end = text.size();
+    else {
+        size_t nl = text.rfind('\n', end);
+        end = (nl==std::string_view::npos || nl < begin) ? begin : nl + 1;
+    }
+    const std::string_view body = text.substr(begin, end - begin);
+
+    std::vector<size_t> cuts{0};
+    const size_t step = std::max(kParallelParseChunk, body.size() / (size_t(std::max(jobs, 1u)) * 4));
+    for (size_t at = step; jobs > 1 && at < body.size(); ){
+        size_t p = body.find('\n', at - 1);
+        while (p!=std::string_view::npos){
+            ++p;
+            if (p < body.size() && body[p]!='\t'){
+                size_t e = body.find('\n', p);
+                if (!trimView(body.substr(p, e==std::string_view::npos ? e : e - p)).empty()) break;
+            }
+            p = body.find('\n', p);
+        }
+        if (p==std::string_view::npos || p >= body.size()) break;
+        cuts.push_back(p);
+        at = p + step;
+    }
+    if (cuts.size()==1) return parseBankText(text, cfg, outBank);
+    cuts.push_back(body.size());
+
+    struct Part { Bank bank; ParseResult res; };
+    std::vector<Part> parts(cuts.size() - 1);
+    {
+        WorkStealingPool pool(std::min<unsigned>(jobs, (unsigned)parts.size()));
+        for (size_t c=0; c<parts.size(); ++c){
+            pool.submit([&, c]{
+                ViewLines lines{body.substr(cuts[c], cuts[c+1] - cuts[c])};
+                BankRecordReader<ViewLines> chunk(lines, cfg);
+                Bank& b = parts[c].bank;
+                b.irStampValue = irStamp(cfg);
+                BankRecordReader<ViewLines>::Record r;
+                while (chunk.next(r)) b.set(r.reg, r.addr, r.value, cfg);
+                parts[c].res = chunk.result();
+            });
+        }
+        pool.wait();
+    }
+
+    outBank = {};
+    outBank.id = rd.id;
+    outBank.title = std::move(rd.title);
+    outBank.irStampValue = irStamp(cfg);
+    for (auto& part : parts){
+        auto& regs = part.bank.regs;
+        outBank.valueBytes += part.bank.valueBytes;
+        while (!regs.empty()){
+            auto node = regs.extract(regs.begin());
+            auto it = outBank.regs.find(node.key());
+            if (it==outBank.regs.end()){ outBank.regs.insert(outBank.regs.end(), std::move(node)); continue; }
+            for (const auto& [aid, val] : node.mapped()){
+                outBank.ir.erase(node.key(), aid);
+                if (const CellValue* old = it->second.find(aid)) outBank.valueBytes -= old->size();  // replaced below
+            }
+            it->second.merge(std::move(node.mapped()));
+        }
+        outBank.ir.merge(std::move(part.bank.ir));
+        if (!part.res.ok) return part.res;
+    }
+    return {};
+}
+
+// A bank file read record by record through a fixed buffer, so its size is
+// not bounded by memory. The header is read on construction.
+class BankStream {
+public:
+    using Record = BankRecordReader<FdLines>::Record;
+
+    BankStream(const fs::path& p, const Config& cfg, size_t bufSize = 64 * 1024)
+        : fd(openFd(p)), lines(fd, bufSize), rd(lines, cfg) {
+        if (fd < 0) hdr = {false, "cannot open: " + p.string()};
+        else hdr = rd.header();
+    }
+    ~BankStream(){
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (fd >= 0) ::close(fd);
+#else
+        if (fd >= 0) ::_close(fd);
+#endif
+    }
+    BankStream(const BankStream&) = delete;
+    BankStream& operator=(const BankStream&) = delete;
+
+    bool ok() const { return hdr.ok; }
+    long long id() const { return rd.id; }
+    const string& title() const { return rd.title; }
+    bool next(Record& r){ return hdr.ok && rd.next(r); }
+    // Header error, or else the body error once next() has returned false.
+    const ParseResult& result() const { return hdr.ok ? rd.result() : hdr; }
+
+private:
+    static int openFd(const fs::path& p){
+#if !defined(_WIN32) && !defined(_WIN64)
+        return ::open(p.c_str(), O_RDONLY);
+#else
+        return ::_wopen(p.c_str(), _O_RDONLY | _O_BINARY);
+#endif
+    }
+    int fd;
+    FdLines lines;
+    BankRecordReader<FdLines> rd;
+    ParseResult hdr;
+};
+
+// Buffered writer straight to a file descriptor. Records are copied into a
+// 1 MiB page-aligned buffer that is written out when full; a piece larger
+// than the buffer goes out with it in one writev() instead of being copied.
+// Memory use is the buffer, whatever the file size.
+class FileWriter {
+public:
+    static constexpr size_t kBufSize = 1 << 20;
+
+    FileWriter() = default;
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+    ~FileWriter(){ (void)close(); }
+
+    bool open(const fs::path& p){
+        (void)close();
+#if !defined(_WIN32) && !defined(_WIN64)
+        fd = ::open(p.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#else
+        fd = ::_wopen(p.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#endif
+        failed = fd < 0;
+        if (!buf) buf.reset(new (std::align_val_t(4096)) char[kBufSize]);
+        used = 0; written = 0;
+        return !failed;
+    }
+    void put(std::string_view s){
+        if (s.size() <= kBufSize - used){
+            std::memcpy(buf.get() + used, s.data(), s.size());
+            used += s.size();
+            return;
+        }
+        if (s.size() < kBufSize){
+            flush();
+            std::memcpy(buf.get(), s.data(), s.size());
+            used = s.size();
+            return;
+        }
+        writeAll(buf.get(), used, s.data(), s.size());
+        used = 0;
+    }
+    void put(char c){
+        if (used == kBufSize) flush();
+        buf[used++] = c;
+    }
+    // toBaseN written in place.
+    void putBaseN(long long val, int base, int width){
+        if (base<2 || base>36) base=10;
+        char tmp[72];
+        char* const end = tmp + sizeof tmp;
+        const unsigned long long mag = val < 0 ? 0ull - (unsigned long long)val : (unsigned long long)val;
+        char* p = writeDigits(mag, unsigned(base), end);
+        if (val < 0) *--p = '-';
+        for (long long pad = (long long)width - (end - p); pad > 0; --pad) put('0');
+        put(std::string_view(p, size_t(end - p)));
+    }
+    void flush(){
+        writeAll(buf.get(), used, nullptr, 0);
+        used = 0;
+    }
+    // Bytes written so far, buffered ones included.
+    unsigned long long offset() const { return written + used; }
+    // Appends len bytes of src from off: copy_file_range where the kernel
+    // offers it (a reflink or server-side copy on filesystems that can),
+    // read/write through the buffer otherwise.
+    void copyFrom(int src, unsigned long long off, unsigned long long len){
+        flush();
+        if (failed || fd < 0) return;
+#if defined(__linux__)
+        while (len > 0){
+            off_t o = (off_t)off;
+            ssize_t n = ::copy_file_range(src, &o, fd, nullptr, (size_t)std::min<unsigned long long>(len, 1ull << 30), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;  // unsupported here, or EOF: fall through
+            off += (unsigned long long)n; len -= (unsigned long long)n; written += (unsigned long long)n;
+        }
+#endif
+        while (len > 0 && !failed){
+            const size_t want = (size_t)std::min<unsigned long long>(len, kBufSize);
+#if !defined(_WIN32) && !defined(_WIN64)
+            ssize_t n = ::pread(src, buf.get(), want, (off_t)off);
+            if (n < 0 && errno == EINTR) continue;
+#else
+            long n = (::_lseeki64(src, (long long)off, SEEK_SET) < 0) ? -1 : ::_read(src, buf.get(), (unsigned)want);
+#endif
+            if (n <= 0){ failed = true; return; }
+            used = size_t(n);
+            flush();
+            off += (unsigned long long)n; len -= (unsigned long long)n;
+        }
+    }
+    // Flushes and closes; false if anything failed to open or write.
+    bool close(){
+        if (fd < 0) return !failed;
+        flush();
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (::close(fd) != 0) failed = true;
+#else
+        if (::_close(fd) != 0) failed = true;
+#endif
+        fd = -1;
+        return !failed;
+    }
+    bool ok() const { return !failed; }
+
+private:
+    void writeAll(const char* a, size_t na, const char* b, size_t nb){
+        if (failed || fd < 0) return;
+#if !defined(_WIN32) && !defined(_WIN64)
+        while (na + nb > 0){
+            struct iovec iov[2] = {{const_cast<char*>(a), na}, {const_cast<char*>(b), nb}};
+            ssize_t n = na ? ::writev(fd, iov, 2) : ::write(fd, b, nb);
+            if (n < 0){
+                if (errno == EINTR) continue;
+                failed = true;
+                return;
+            }
+            written += (unsigned long long)n;
+            size_t done = size_t(n);
+            const size_t fromA = std::min(done, na);
+            a += fromA; na -= fromA; done -= fromA;
+            b += done; nb -= done;
+        }
+#else
+        for (auto [p, n] : {std::pair{a, na}, std::pair{b, nb}}){
+            while (n > 0){
+                int got = ::_write(fd, p, (unsigned)std::min<size_t>(n, 1u << 30));
+                if (got <= 0){ failed = true; return; }
+                p += got; n -= size_t(got); written += (unsigned long long)got;
+            }
+        }
+#endif
+    }
+    struct AlignedDelete {
+        void operator()(char* p) const { ::operator delete[](p, std::align_val_t(4096)); }
+    };
+    int fd = -1;
+    bool failed = false;
+    std::unique_ptr<char[], AlignedDelete> buf;
+    size_t used = 0;
+    unsigned long long written = 0;
+};
+
+// The same output collected in a string, for writeBankText.
+struct StringWriter {
+    string out;
+    void put(std::string_view s){ out.append(s); }
+    void put(char c){ out.push_back(c); }
+    void putBaseN(long long val, int base, int width){ appendBaseN(out, val, base, width); }
+    unsigned long long offset() const { return out.size(); }
+};
+
+// Checks that text is exactly what writeBank would write, following along
+// instead of writing; offsets then describe text.
+struct CompareWriter {
+    std::string_view text;
+    size_t pos = 0;
+    bool mismatch = false;
+    void put(std::string_view s){
+        if (mismatch || text.size() - pos < s.size() || std::memcmp(text.data() + pos, s.data(), s.size()) != 0){
+            mismatch = true;
+            return;
+        }
+        pos += s.size();
+    }
+    void put(char c){ put(std::string_view(&c, 1)); }
+    void putBaseN(long long val, int base, int width){
+        char tmp[80];
+        if (width > 0 && width < 8){  // the usual case, without a string
+            if (base<2 || base>36) base=10;
+            char* const end = tmp + sizeof tmp;
+            const unsigned long long mag = val < 0 ? 0ull - (unsigned long long)val : (unsigned long long)val;
+            char* p = writeDigits(mag, unsigned(base), end);
+            if (val < 0) *--p = '-';
+            while (end - p < width) *--p = '0';
+            put(std::string_view(p, size_t(end - p)));
+        }
+        else put(toBaseN(val, base, width));
+    }
+    unsigned long long offset() const { return pos; }
+};
+
+// Byte ranges of a bank file written by writeBank: the header line, and each
+// register's lines (its own line when there are several, then its cells).
+// Valid for the file with that stamp under the same prefix/base/widths.
+struct BankLayout {
+    FileStamp stamp;
+    char prefix = 'x';
+    int base = 10, widthBank = 0, widthReg = 0, widthAddr = 0;
+    string header;
+    bool multi = false;
+    std::map<long long, std::pair<unsigned long long, unsigned long long>> regs;  // [begin, end)
+
+    bool sameFormat(const Config& cfg) const {
+        return prefix==cfg.prefix && base==cfg.base && widthBank==cfg.widthBank
+            && widthReg==cfg.widthReg && widthAddr==cfg.widthAddr;
+    }
+};
+
+// Registers of a previous file that writeBank may copy rather than format:
+// those in layout and not in dirty, read from fd.
+struct ReusedRegisters {
+    const BankLayout* layout;
+    const std::set<long long>* dirty;
+    int fd;
+};
+
+inline string bankHeaderLine(const Bank& b, const Config& cfg){
+    string h(1, cfg.prefix);
+    appendBaseN(h, b.id, cfg.base, cfg.widthBank);
+    h += "\t(";
+    h += b.title;
+    h += "){\n";
+    return h;
+}
+
+// A bank in the file format, written record by record to w (FileWriter,
+// StringWriter or CompareWriter). With record, the byte ranges written are
+// noted there; with reuse (FileWriter only), unchanged registers are copied
+// from the previous file.
+template<class Writer>
+inline void writeBank(const Bank& b, const Config& cfg, Writer& w,
+                      BankLayout* record = nullptr, const ReusedRegisters* reuse = nullptr){
+    string header = bankHeaderLine(b, cfg);
+    w.put(header);
+    bool multi = (b.regs.size()>1) || (b.regs.size()==1 && b.regs.begin()->first!=1);
+    if (record){
+        record->header = std::move(header);
+        record->multi = multi;
+        record->regs.clear();
+    }
+    auto reg = [&](long long rid, const AddrTable& addrs){
+        const unsigned long long from = w.offset();
+        if constexpr (requires { w.copyFrom(0, 0ull, 0ull); }){
+            if (reuse && !reuse->dirty->count(rid)){
+                auto it = reuse->layout->regs.find(rid);
+                if (it != reuse->layout->regs.end()){
+                    w.copyFrom(reuse->fd, it->second.first, it->second.second - it->second.first);
+                    if (record) record->regs[rid] = {from, w.offset()};
+                    return;
+                }
+            }
+        }
+        if (multi){
+            w.putBaseN(rid, cfg.base, cfg.widthReg);
+            w.put('\n');
+        }
+        for (const auto& [aid, val] : addrs){
+            w.put('\t');
+            w.putBaseN(aid, cfg.base, cfg.widthAddr);
+            w.put('\t');
+            w.put(val);
+            w.put('\n');
+        }
+        if (record) record->regs[rid] = {from, w.offset()};
+    };
+    if (!multi){
+        auto it = b.regs.find(1);
+        if (it != b.regs.end()) reg(1, it->second);
+    } else {
+        for (auto& [rid, addrs] : b.regs) reg(rid, addrs);
+    }
+    w.put("}\n");
+}
+
+inline string writeBankText(const Bank& b, const Config& cfg){
+    StringWriter w;
+    writeBank(b, cfg, w);
+    return std::move(w.out);
+}
+
+inline fs::path contextFileName(const Config& cfg, long long bankId){
+    return fs::path("files") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".txt");
+}
+inline fs::path outResolvedName(const Config& cfg, long long bankId){
+    return fs::path("files/out") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".resolved.txt");
+}
+inline fs::path outJsonName(const Config& cfg, long long bankId){
+    return fs::path("files/out") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".json");
+}
+
+// Layout of text as the file bank was just parsed from, if text is exactly
+// what writeBank writes for it. Only kept for files big enough that
+// rewriting them costs more than this check (one comparison pass).
+constexpr unsigned long long kLayoutMinSize = 1 << 20;
+
+inline std::shared_ptr<const BankLayout> captureLayout(std::string_view text, const FileStamp& stamp,
+                                                       const Bank& b, const Config& cfg){
+    if (text.size() < kLayoutMinSize || stamp.size != text.size()) return nullptr;
+    auto layout = std::make_shared<BankLayout>();
+    CompareWriter cmp{text};
+    writeBank(b, cfg, cmp, layout.get());
+    if (cmp.mismatch || cmp.pos != text.size()) return nullptr;
+    layout->stamp = stamp;
+    layout->prefix = cfg.prefix; layout->base = cfg.base;
+    layout->widthBank = cfg.widthBank; layout->widthReg = cfg.widthReg; layout->widthAddr = cfg.widthAddr;
+    return layout;
+}
+
+inline bool loadContextFile(const Config& cfg, const fs::path& file, Bank& bank, string& err){
+    if (!fs::exists(file)) { err = "file not found: " + file.string(); return false; }
+    FileStamp stamp;
+    const bool stamped = statFile(file, stamp);
+    MappedFile map;
+    if (!map.open(file, err)) return false;
+    const unsigned jobs = map.size() >= 4 * kParallelParseChunk ? defaultJobs() : 1;
+    ParseResult pr = parseBankTextParallel(map.view(), cfg, bank, jobs);
+    if (!pr.ok) { err = pr.err; return false; }
+    if (stamped) bank.layout = captureLayout(map.view(), stamp, bank, cfg);
+    return true;
+}
+// Steps run around the rename that replaces a file: before() once the temp
+// file is complete (returning false abandons the save), after(replaced)
+// whenever before() succeeded.
+struct ReplaceHooks {
+    std::function<bool(const fs::path& tmp, string& err)> before;
+    std::function<void(bool replaced)> after;
+};
+
+// --- writeFileAtomic: ensure dirs; write atomically-ish -------------------
+// fill(FileWriter&) produces the content into path.tmp, which then replaces
+// path.
+template<class Fill>
+inline bool writeFileAtomicWith(const std::filesystem::path& path, Fill&& fill, std::string& err,
+                                const ReplaceHooks* hooks = nullptr)
+{
+    try {
+        std::filesystem::create_directories(path.parent_path());
+
+        // Write to a temp file first
+        auto tmp = path; tmp += ".tmp";
+        {
+            FileWriter out;
+            if (!out.open(tmp)) { err = "Cannot open temp file for write: " + tmp.string(); return false; }
+            fill(out);
+            if (!out.close()) { err = "Write failed: " + tmp.string(); return false; }
+        }
+        if (hooks && hooks->before && !hooks->before(tmp, err)) { std::filesystem::remove(tmp); return false; }
+
+        // Replace the target (works across volumes with fallback)
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            std::filesystem::copy_file(tmp, path,
+                std::filesystem::copy_options::overwrite_existing, ec);
+            std::filesystem::remove(tmp);
+            if (ec) {
+                if (hooks && hooks->after) hooks->after(false);
+                err = "Replace failed: " + path.string() + " (" + ec.message() + ")"; return false;
+            }
+        }
+        if (hooks && hooks->after) hooks->after(true);
+        return true;
+    } catch (const std::exception& e) {
+        err = e.what();
+        return false;
+    }
+}
+
+inline bool writeFileAtomic(const std::filesystem::path& path, std::string_view data, std::string& err)
+{
+    return writeFileAtomicWith(path, [&](FileWriter& w){ w.put(data); }, err);
+}
+
+// Streams the bank into the temp file, so saving takes no extra memory
+// proportional to the bank.
+inline bool saveContextFile(const Config& cfg,
+                            const std::filesystem::path& path,
+                            const Bank& b,
+                            std::string& err)
+{
+    return writeFileAtomicWith(path, [&](FileWriter& w){ writeBank(b, cfg, w); }, err);
+}
+
+// Saving a bank the workspace owns. If b.layout still describes path, the
+// save is incremental: registers not in b.dirtyRegs are copied from the old
+// file (see FileWriter::copyFrom) and only the changed ones are formatted;
+// with nothing changed there is nothing to write. Either way b.layout then
+// describes the new file and dirtyRegs is cleared.
+inline bool saveContextFile(const Config& cfg,
+                            const std::filesystem::path& path,
+                            Bank& b,
+                            std::string& err,
+                            const ReplaceHooks* hooks = nullptr)
+{
+    std::shared_ptr<const BankLayout> old = b.layout;
+    FileStamp now;
+    if (old && (!old->sameFormat(cfg) || !statFile(path, now) || !(now == old->stamp)
+                || old->header != bankHeaderLine(b, cfg)))
+        old = nullptr;
+    const bool multi = (b.regs.size()>1) || (b.regs.size()==1 && b.regs.begin()->first!=1);
+    if (old && old->multi != multi) old = nullptr;
+    if (old && !hooks && b.dirtyRegs.empty() && old->regs.size()==b.regs.size()
+        && std::equal(old->regs.begin(), old->regs.end(), b.regs.begin(),
+                      [](auto& x, auto& y){ return x.first==y.first; }))
+        return true;
+
+    int src = -1;
+    if (old){
+#if !defined(_WIN32) && !defined(_WIN64)
+        src = ::open(path.c_str(), O_RDONLY);
+#else
+        src = ::_wopen(path.c_str(), _O_RDONLY | _O_BINARY);
+#endif
+        if (src < 0) old = nullptr;
+    }
+    auto layout = std::make_shared<BankLayout>();
+    ReusedRegisters reuse{old.get(), &b.dirtyRegs, src};
+    auto closeSrc = [&]{
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (src >= 0) ::close(src);
+#else
+        if (src >= 0) ::_close(src);
+#endif
+        src = -1;
+    };
+    // The old file is closed before the temp file replaces it.
+    bool ok = writeFileAtomicWith(path, [&](FileWriter& w){
+        writeBank(b, cfg, w, layout.get(), old ? &reuse : nullptr);
+        closeSrc();
+    }, err, hooks);
+    closeSrc();
+    b.dirtyRegs.clear();
+    if (ok && statFile(path, layout->stamp)){
+        layout->prefix = cfg.prefix; layout->base = cfg.base;
+        layout->widthBank = cfg.widthBank; layout->widthReg = cfg.widthReg; layout->widthAddr = cfg.widthAddr;
+        b.layout = std::move(layout);
+    }
+    else b.layout = nullptr;
+    return ok;
+}
+
+// ----------------------------- Edit journal (.wal) -----------------------------
+// files/<ctx>.wal holds edits made since files/<ctx>.txt was written, as
+// binary records appended and fdatasync'd one by one, so an edit is durable
+// without rewriting the bank. The header names the text file the records
+// apply to by its FileStamp; a journal for any other version of the file is
+// stale and ignored. Records set or erase one cell outright, so replaying
+// them over a text file that already holds some of them gives the same
+// bank. A record with a bad length or checksum (a torn append) ends the
+// journal.
+//
+// Compaction folds the journal into the text file on a background thread
+// and replaces both together: the new journal (records appended meanwhile,
+// bound to the new text file) is written to <ctx>.wal.next before the text
+// file is renamed, then renamed over <ctx>.wal. A crash between the two
+// renames leaves a .wal.next that matches the text file, and opening takes
+// that instead.
+struct WalHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::int64_t bankId;
+    std::int64_t mtimeNs;
+    std::uint64_t size;
+    std::uint64_t inode;
+};
+static_assert(sizeof(WalHeader) == 48, "WalHeader layout");
+inline constexpr char kWalMagic[8] = {'S','C','R','W','A','L','\0','\0'};
+inline constexpr std::uint32_t kWalVersion = 1;
+// Record: u32 payload length, u32 CRC-32 of the payload, then the payload:
+// u8 op, i64 reg, i64 addr, value bytes (set only).
+enum class WalOp : std::uint8_t { Set = 1, Erase = 2 };
+inline constexpr size_t kWalRecordHead = 8, kWalPayloadMin = 17;
+
+inline constexpr auto kCrc32Table = []{
+    std::array<std::uint32_t, 256> t{};
+    for (std::uint32_t i = 0; i < 256; ++i){
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        t[i] = c;
+    }
+    return t;
+}();
+inline std::uint32_t crc32(const char* p, size_t n){
+    std::uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < n; ++i) c = kCrc32Table[(c ^ (unsigned char)p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+inline fs::path journalFileName(const Config& cfg, long long bankId){
+    return fs::path("files") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".wal");
+}
+
+inline WalHeader makeWalHeader(long long bankId, const FileStamp& text){
+    WalHeader h{};
+    std::memcpy(h.magic, kWalMagic, sizeof h.magic);
+    h.version = kWalVersion;
+    h.bankId = bankId;
+    h.mtimeNs = text.mtimeNs; h.size = text.size; h.inode = text.inode;
+    return h;
+}
+inline bool walMatches(const WalHeader& h, long long bankId, const FileStamp& text){
+    return std::memcmp(h.magic, kWalMagic, sizeof h.magic)==0 && h.version==kWalVersion && h.bankId==bankId
+        && h.mtimeNs==text.mtimeNs && h.size==text.size && h.inode==text.inode;
+}
+
+inline void encodeWalRecord(string& out, WalOp op, long long reg, long long addr, std::string_view value){
+    const std::uint32_t len = std::uint32_t(kWalPayloadMin + value.size());
+    const size_t at = out.size();
+    out.resize(at + kWalRecordHead + len);
+    char* p = out.data() + at + kWalRecordHead;
+    p[0] = char(op);
+    std::int64_t r = reg, a = addr;
+    std::memcpy(p + 1, &r, 8);
+    std::memcpy(p + 9, &a, 8);
+    if (!value.empty()) std::memcpy(p + kWalPayloadMin, value.data(), value.size());
+    const std::uint32_t crc = crc32(p, len);
+    std::memcpy(out.data() + at, &len, 4);
+    std::memcpy(out.data() + at + 4, &crc, 4);
+}
+
+// Calls apply(op, reg, addr, value) for each intact record of a journal body
+// (the bytes after the header); returns the length of the intact prefix.
+template<class Apply>
+inline size_t forEachWalRecord(std::string_view body, Apply&& apply){
+    size_t at = 0;
+    while (body.size() - at >= kWalRecordHead){
+        std::uint32_t len, crc;
+        std::memcpy(&len, body.data() + at, 4);
+        std::memcpy(&crc, body.data() + at + 4, 4);
+        if (len < kWalPayloadMin || body.size() - at - kWalRecordHead < len) break;
+        const char* p = body.data() + at + kWalRecordHead;
+        if (crc32(p, len) != crc) break;
+        const WalOp op = WalOp(std::uint8_t(p[0]));
+        if (op != WalOp::Set && op != WalOp::Erase) break;
+        std::int64_t reg, addr;
+        std::memcpy(&reg, p + 1, 8);
+        std::memcpy(&addr, p + 9, 8);
+        apply(op, (long long)reg, (long long)addr, std::string_view(p + kWalPayloadMin, len - kWalPayloadMin));
+        at += kWalRecordHead + len;
+    }
+    return at;
+}
+
+inline void applyWalRecord(const Config& cfg, Bank& b, WalOp op, long long reg, long long addr, std::string_view value){
+    if (op == WalOp::Set) b.set(reg, addr, value, cfg);
+    else b.erase(reg, addr);
+}
+
+inline bool syncFileData(int fd){
+#if !defined(_WIN32) && !defined(_WIN64)
+  #if defined(__APPLE__)
+    return ::fsync(fd) == 0;
+  #else
+    return ::fdatasync(fd) == 0;
+  #endif
+#else
+    return ::_commit(fd) == 0;
+#endif
+}
+inline int openForWrite(const fs::path& p, bool truncate){
+#if !defined(_WIN32) && !defined(_WIN64)
+    return ::open(p.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0666);
+#else
+    return ::_wopen(p.c_str(), _O_RDWR | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0), _S_IREAD | _S_IWRITE);
+#endif
+}
+inline void closeFd(int fd){
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (fd >= 0) ::close(fd);
+#else
+    if (fd >= 0) ::_close(fd);
+#endif
+}
+inline bool writeFully(int fd, const char* p, size_t n){
+    while (n > 0){
+#if !defined(_WIN32) && !defined(_WIN64)
+        ssize_t got = ::write(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+#else
+        int got = ::_write(fd, p, (unsigned)std::min<size_t>(n, 1u << 30));
+#endif
+        if (got <= 0) return false;
+        p += got; n -= size_t(got);
+    }
+    return true;
+}
+
+// The journal that belongs to the text file as it is now: <ctx>.wal, or a
+// <ctx>.wal.next left by a compaction interrupted between its renames (it
+// is moved into place). Empty when there is none.
+inline MappedFile openMatchingJournal(const Config& cfg, long long bankId, const FileStamp& text){
+    const fs::path wal = journalFileName(cfg, bankId);
+    fs::path next = wal; next += ".next";
+    for (const fs::path& p : {wal, next}){
+        std::error_code ec;
+        if (!fs::exists(p, ec)) continue;
+        MappedFile m;
+        string err;
+        if (!m.open(p, err) || m.size() < sizeof(WalHeader)) continue;
+        WalHeader h;
+        std::memcpy(&h, m.view().data(), sizeof h);
+        if (!walMatches(h, bankId, text)) continue;
+        if (p == next){
+            m.reset();
+            fs::rename(next, wal, ec);
+            if (ec || !m.open(wal, err)) return {};
+        }
+        return m;
+    }
+    return {};
+}
+
+// Applies the bank's journal, if cfg.journal is on and it belongs to the text
+// file as it is now; returns the number of records applied.
+inline size_t replayJournal(const Config& cfg, long long bankId, Bank& bank){
+    if (!cfg.journal) return 0;
+    FileStamp text;
+    if (!statFile(contextFileName(cfg, bankId), text)) text = {};
+    MappedFile m = openMatchingJournal(cfg, bankId, text);
+    if (m.size() < sizeof(WalHeader)) return 0;
+    size_t n = 0;
+    forEachWalRecord(m.view().substr(sizeof(WalHeader)), [&](WalOp op, long long reg, long long addr, std::string_view v){
+        applyWalRecord(cfg, bank, op, reg, addr, v);
+        ++n;
+    });
+    return n;
+}
+
+// An open journal for one bank. append() is durable when it returns;
+// past kCompactBytes a compaction starts in the background. save() writes
+// the bank itself (it has every journaled edit) and empties the journal.
+// The Config is passed to each call rather than kept, so a save after a
+// :set writes the current format; file names are fixed at open() (close
+// and reopen the journal when prefix, base or widthBank change). If the new
+// journal cannot be put in place after the text file was replaced, the
+// journal closes: append() fails, so edits stay unsaved in memory, until a
+// save() writes the bank and starts the journal over.
+class Journal {
+public:
+    static constexpr unsigned long long kCompactBytes = 4ull << 20;
+
+    explicit Journal(long long bankId): id(bankId) {}
+    ~Journal(){ wait(); closeFd(fd); }
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Continues the journal matching the text file, or starts an empty one.
+    bool open(const Config& cfg, string& err){
+        std::lock_guard lk(mu);
+        textPath = contextFileName(cfg, id);
+        walPath = journalFileName(cfg, id);
+        FileStamp text;
+        if (!statFile(textPath, text)) text = {};
+        MappedFile m = openMatchingJournal(cfg, id, text);
+        size_t keep = 0;
+        if (m.size() >= sizeof(WalHeader))
+            keep = sizeof(WalHeader) + forEachWalRecord(m.view().substr(sizeof(WalHeader)), [](auto...){});
+        m.reset();
+        closeFd(fd);
+        fd = openForWrite(walPath, keep == 0);
+        if (fd < 0){ err = "cannot open journal: " + walPath.string(); return false; }
+        if (keep == 0){
+            WalHeader h = makeWalHeader(id, text);
+            if (!writeFully(fd, reinterpret_cast<const char*>(&h), sizeof h) || !syncFileData(fd)){
+                err = "cannot write journal"; return false;
+            }
+            keep = sizeof h;
+        }
+        else if (!truncateTo(keep)){ err = "cannot trim journal"; return false; }
+        end = keep;
+        return true;
+    }
+
+    bool set(const Config& cfg, long long reg, long long addr, std::string_view value){
+        string rec;
+        encodeWalRecord(rec, WalOp::Set, reg, addr, value);
+        return append(cfg, rec);
+    }
+    bool erase(const Config& cfg, long long reg, long long addr){
+        string rec;
+        encodeWalRecord(rec, WalOp::Erase, reg, addr, {});
+        return append(cfg, rec);
+    }
+
+    // Appends records made with encodeWalRecord, whole or not at all. With
+    // sync, everything appended so far is durable when it returns; a batch
+    // passes sync=false for all but its last part and so syncs once.
+    bool append(const Config& cfg, std::string_view records, bool sync = true){
+        bool compactNow;
+        {
+            std::lock_guard lk(mu);
+            if (fd < 0) return false;
+            if (!writeFully(fd, records.data(), records.size()) || (sync && !syncFileData(fd))){
+                (void)truncateTo(end);  // drop a partial record
+                return false;
+            }
+            end += records.size();
+            compactNow = sync && end - sizeof(WalHeader) >= kCompactBytes;
+        }
+        if (compactNow) compactAsync(cfg);
+        return true;
+    }
+
+    // Bytes of records not yet folded into the text file.
+    unsigned long long pending() const { std::lock_guard lk(mu); return end - sizeof(WalHeader); }
+
+    // Folds the journal into the text file on a background thread; a
+    // compaction still running makes this a no-op, a finished one is
+    // joined first.
+    void compactAsync(const Config& cfg){
+        std::lock_guard lk(threadMu);
+        if (worker.joinable()){
+            if (!done.load(std::memory_order_acquire)) return;
+            worker.join();
+        }
+        done.store(false, std::memory_order_relaxed);
+        worker = std::thread([this, cfg]{
+            string err;
+            (void)compact(cfg, err);
+            done.store(true, std::memory_order_release);
+        });
+    }
+    void wait(){
+        std::lock_guard lk(threadMu);
+        if (worker.joinable()) worker.join();
+    }
+
+    // The text file rewritten from the journal's records up to now; records
+    // appended meanwhile carry over to the new journal.
+    bool compact(const Config& cfg, string& err){
+        unsigned long long upTo;
+        { std::lock_guard lk(mu); upTo = end; }
+        Bank b;
+        FileStamp text;
+        if (statFile(textPath, text)){
+            MappedFile map;
+            if (!map.open(textPath, err)) return false;
+            ParseResult pr = parseBankTextParallel(map.view(), cfg, b, 1);
+            if (!pr.ok){ err = pr.err; return false; }
+            b.layout = captureLayout(map.view(), text, b, cfg);
+        }
+        else { b.id = id; text = {}; }
+        {
+            MappedFile m;
+            if (!m.open(walPath, err) || m.size() < upTo) { err = "journal changed"; return false; }
+            WalHeader h;
+            std::memcpy(&h, m.view().data(), sizeof h);
+            if (!walMatches(h, id, text)){ err = "journal does not match " + textPath.string(); return false; }
+            forEachWalRecord(m.view().substr(sizeof(WalHeader), upTo - sizeof(WalHeader)),
+                             [&](WalOp op, long long reg, long long addr, std::string_view v){ applyWalRecord(cfg, b, op, reg, addr, v); });
+        }
+        return replaceText(cfg, b, upTo, err);
+    }
+
+    // Saves bank (which holds every journaled edit) and empties the journal.
+    bool save(const Config& cfg, Bank& bank, string& err){
+        wait();
+        unsigned long long upTo;
+        { std::lock_guard lk(mu); upTo = end; }
+        return replaceText(cfg, bank, upTo, err);
+    }
+
+private:
+    bool truncateTo(unsigned long long n){
+#if !defined(_WIN32) && !defined(_WIN64)
+        return ::ftruncate(fd, (off_t)n) == 0 && ::lseek(fd, (off_t)n, SEEK_SET) >= 0;
+#else
+        return ::_chsize_s(fd, (long long)n) == 0 && ::_lseeki64(fd, (long long)n, SEEK_SET) >= 0;
+#endif
+    }
+
+    // Writes b as the text file and, in the same step, a journal holding the
+    // records after upTo, bound to the new file (see the section comment).
+    bool replaceText(const Config& cfg, Bank& b, unsigned long long upTo, string& err){
+        fs::path nextPath = walPath; nextPath += ".next";
+        std::unique_lock<std::mutex> held;
+        int next = -1;
+        ReplaceHooks hooks;
+        hooks.before = [&](const fs::path& tmp, string& e){
+            int t = openForWrite(tmp, false);
+            const bool synced = t >= 0 && syncFileData(t);
+            closeFd(t);
+            FileStamp st;
+            if (!synced || !statFile(tmp, st)){ e = "cannot sync " + tmp.string(); return false; }
+            held = std::unique_lock<std::mutex>(mu);  // appends wait from here to the rename
+            string carry;
+            {
+                MappedFile m;
+                string me;
+                if (end > upTo && m.open(walPath, me) && m.size() >= end)
+                    carry.assign(m.view().substr(upTo, end - upTo));
+            }
+            WalHeader h = makeWalHeader(id, st);
+            next = openForWrite(nextPath, true);
+            if (next < 0 || !writeFully(next, reinterpret_cast<const char*>(&h), sizeof h)
+                || !writeFully(next, carry.data(), carry.size()) || !syncFileData(next)){
+                closeFd(next); next = -1;
+                held.unlock();
+                e = "cannot write " + nextPath.string();
+                return false;
+            }
+            return true;
+        };
+        hooks.after = [&](bool replaced){
+            std::error_code ec;
+            if (!replaced){
+                closeFd(next); next = -1;
+                fs::remove(nextPath, ec);
+                held.unlock();
+                return;
+            }
+            // The old journal belongs to the old text file: from here on the
+            // journal is the new one or none at all.
+            FileStamp st;
+            bool ok = statFile(textPath, st);
+            if (ok){
+                // A copy fallback gives the text file a new stamp.
+                WalHeader h = makeWalHeader(id, st);
+#if !defined(_WIN32) && !defined(_WIN64)
+                ok = ::pwrite(next, &h, sizeof h, 0) == (ssize_t)sizeof h && syncFileData(next);
+#else
+                ok = ::_lseeki64(next, 0, SEEK_SET) == 0 && writeFully(next, reinterpret_cast<const char*>(&h), sizeof h)
+                     && ::_lseeki64(next, 0, SEEK_END) >= 0 && syncFileData(next);
+#endif
+            }
+            const unsigned long long size = sizeof(WalHeader) + (end - upTo);
+            closeFd(next); next = -1;
+            closeFd(fd); fd = -1;
+            if (ok) fs::rename(nextPath, walPath, ec);
+            if (ok && !ec) fd = openForWrite(walPath, false);
+            if (fd >= 0 && truncateTo(size)) end = size;
+            else { closeFd(fd); fd = -1; }  // appends fail until the next save()
+            held.unlock();
+        };
+        return saveContextFile(cfg, textPath, b, err, &hooks);
+    }
+
+    long long id;
+    fs::path textPath, walPath;  // named when opened; fixed after
+    mutable std::mutex mu;       // fd, end
+    int fd = -1;
+    unsigned long long end = 0;  // journal length: header + intact records
+    std::mutex threadMu;
+    std::thread worker;
+    std::atomic<bool> done{false};  // worker has finished
+};
+
+// The bank's journal while cfg.journal is on, opened on first use.
+inline Journal* journalFor(const Config& cfg, Workspace& ws, long long bank){
+    if (!cfg.journal) return nullptr;
+    auto& j = ws.journals[bank];
+    if (!j){
+        auto fresh = std::make_shared<Journal>(bank);
+        string err;
+        if (!fresh->open(cfg, err)){ ws.journals.erase(bank); return nullptr; }
+        j = std::move(fresh);
+    }
+    return j.get();
+}
+inline bool journalSet(const Config& cfg, Journal& j, long long reg, long long addr, std::string_view value){
+    return j.set(cfg, reg, addr, value);
+}
+inline bool journalErase(const Config& cfg, Journal& j, long long reg, long long addr){ return j.erase(cfg, reg, addr); }
+
+// setCell for each record of in (BankStream or the like), journaled as one
+// batch that is synced once rather than per record. Returns whether every
+// record reached the journal (false with cfg.journal off).
+template<class Reader>
+inline bool setCells(const Config& cfg, Workspace& ws, long long bank, Reader& in){
+    constexpr size_t kBatchPart = 1 << 20;
+    Journal* j = journalFor(cfg, ws, bank);
+    bool logged = j != nullptr;
+    string batch;
+    typename Reader::Record r;
+    while (in.next(r)){
+        if (logged){
+            encodeWalRecord(batch, WalOp::Set, r.reg, r.addr, r.value);
+            if (batch.size() >= kBatchPart){
+                logged = j->append(cfg, batch, false);
+                batch.clear();
+            }
+        }
+        storeCell(cfg, ws, bank, r.reg, r.addr, r.value);
+    }
+    return logged && j->append(cfg, batch, true);
+}
+
+// Writes bank `id` to files/<ctx>.txt; a journaled bank's journal is emptied
+// in the same step.
+inline bool saveWorkspaceBank(const Config& cfg, Workspace& ws, long long id, string& err){
+    auto it = ws.journals.find(id);
+    if (it != ws.journals.end()) return it->second->save(cfg, ws.banks[id], err);
+    return saveContextFile(cfg, contextFileName(cfg, id), ws.banks[id], err);
+}
+
+// ----------------------------- Compiled banks (.bankc) -----------------------------
+// Binary companion of files/<ctx>.txt for lookups without parsing the text:
+//   BankcHeader | BankcEntry[count], sorted by (reg, addr) | value heap
+// Entry offsets are relative to the heap; the title is stored in the heap too.
+// Native byte order (checked through byteOrder); the header records the
+// source text's FileStamp and the prefix/base it was parsed with, and any
+// mismatch makes the file stale.
+struct BankcHeader {
+    char magic[8];
+    std::uint32_t byteOrder;
+    std::uint32_t version;
+    std::int64_t bankId;
+    std::uint64_t count;
+    std::int64_t srcMtimeNs;
+    std::uint64_t srcSize;
+    std::uint64_t srcInode;
+    std::uint64_t titleOff;
+    std::uint32_t titleLen;
+    std::uint8_t prefix;
+    std::uint8_t base;
+    std::uint16_t reserved;
+};
+struct BankcEntry {
+    std::int64_t reg, addr;
+    std::uint64_t off, len;
+};
+static_assert(sizeof(BankcHeader) == 72 && sizeof(BankcEntry) == 32, "packed .bankc layout");
+inline constexpr char kBankcMagic[8] = {'S','C','B','A','N','K','C','\0'};
+inline constexpr std::uint32_t kBankcVersion = 1;
+
+inline fs::path compiledFileName(const Config& cfg, long long bankId){
+    return fs::path("files") / (string(1,cfg.prefix) + toBaseN(bankId, cfg.base, cfg.widthBank) + ".bankc");
+}
+
+// Streamed: the directory, then the heap, each in regs order.
+inline bool writeCompiledBank(const Config& cfg, const Bank& b, const FileStamp& source,
+                              const fs::path& path, string& err){
+    size_t count = 0;
+    for (auto& [rid, addrs] : b.regs) count += addrs.size();
+    BankcHeader h{};
+    std::memcpy(h.magic, kBankcMagic, sizeof h.magic);
+    h.byteOrder = 0x01020304u;
+    h.version = kBankcVersion;
+    h.bankId = b.id;
+    h.count = count;
+    h.srcMtimeNs = source.mtimeNs;
+    h.srcSize = source.size;
+    h.srcInode = source.inode;
+    h.titleOff = 0;
+    h.titleLen = (std::uint32_t)b.title.size();
+    h.prefix = (std::uint8_t)cfg.prefix;
+    h.base = (std::uint8_t)cfg.base;
+
+    return writeFileAtomicWith(path, [&](FileWriter& w){
+        w.put(std::string_view(reinterpret_cast<const char*>(&h), sizeof h));
+        size_t off = b.title.size();
+        for (auto& [rid, addrs] : b.regs)
+            for (const auto& [aid, val] : addrs){
+                BankcEntry e{rid, aid, off, val.size()};
+                w.put(std::string_view(reinterpret_cast<const char*>(&e), sizeof e));
+                off += val.size();
+            }
+        w.put(b.title);
+        for (auto& [rid, addrs] : b.regs)
+            for (const auto& [aid, val] : addrs) w.put(val.view());
+    }, err);
+}
+
+// A mapped .bankc. find() binary-searches the directory; cell() also keeps
+// the compiled references of what it returned for the Resolver, at most
+// about kMaxCells of them (see trim()).
+class CompiledBank {
+public:
+    static constexpr size_t kMaxCells = 1 << 16;
+
+    bool open(const fs::path& p, string& err){
+        if (!map.open(p, err)) return false;
+        std::string_view v = map.view();
+        if (v.size() < sizeof h){ err = "truncated: " + p.string(); return false; }
+        std::memcpy(&h, v.data(), sizeof h);
+        if (std::memcmp(h.magic, kBankcMagic, sizeof h.magic) != 0 || h.byteOrder != 0x01020304u || h.version != kBankcVersion){
+            err = "not a compiled bank: " + p.string(); return false;
+        }
+        if (h.count > (v.size() - sizeof h) / sizeof(BankcEntry)){ err = "truncated: " + p.string(); return false; }
+        dir = reinterpret_cast<const BankcEntry*>(v.data() + sizeof h);
+        heap = v.substr(sizeof h + h.count * sizeof(BankcEntry));
+        if (h.titleOff > heap.size() || h.titleLen > heap.size() - h.titleOff){ err = "corrupt title: " + p.string(); return false; }
+        return true;
+    }
+    // Out of date for this text file and Config?
+    bool stale(const Config& cfg, const FileStamp& source) const {
+        return FileStamp{h.srcMtimeNs, h.srcSize, h.srcInode} != source
+            || h.prefix != (std::uint8_t)cfg.prefix || h.base != (std::uint8_t)cfg.base;
+    }
+    long long id() const { return h.bankId; }
+    size_t size() const { return (size_t)h.count; }
+    std::string_view title() const { return heap.substr(h.titleOff, h.titleLen); }
+
+    std::optional<std::string_view> find(long long reg, long long addr) const {
+        const BankcEntry* end = dir + h.count;
+        const BankcEntry* it = std::lower_bound(dir, end, std::make_pair(reg, addr),
+            [](const BankcEntry& e, const std::pair<long long, long long>& k){
+                return std::make_pair((long long)e.reg, (long long)e.addr) < k;
+            });
+        if (it==end || it->reg!=reg || it->addr!=addr || !inHeap(*it)) return std::nullopt;
+        return heap.substr(it->off, it->len);
+    }
+    std::optional<std::string_view> cell(const Config& cfg, long long reg, long long addr, CellRefs& refs){
+        if (cellsStamp != irStamp(cfg)){ cells.clear(); cellsStamp = irStamp(cfg); }
+        auto it = cells.find({reg, addr});
+        if (it == cells.end()){
+            auto v = find(reg, addr);
+            if (!v) return std::nullopt;
+            it = cells.emplace(std::make_pair(reg, addr), Cold{*v, compileCell(*v, cfg)}).first;
+        }
+        refs = it->second.refs;
+        return it->second.value;
+    }
+    // Forgets the cells past kMaxCells. The Resolver calls this between
+    // expansions, when no CellRefs from cell() is in use.
+    void trim(){ if (cells.size() > kMaxCells) cells.clear(); }
+    void toBank(const Config& cfg, Bank& out) const {
+        out = {};
+        out.id = h.bankId;
+        out.title = string(title());
+        out.irStampValue = irStamp(cfg);
+        for (size_t i=0; i<h.count; ++i)
+            if (inHeap(dir[i])) out.set(dir[i].reg, dir[i].addr, heap.substr(dir[i].off, dir[i].len), cfg);
+    }
+
+private:
+    // Entries are bounds-checked when used, so opening stays O(1).
+    bool inHeap(const BankcEntry& e) const { return e.off <= heap.size() && e.len <= heap.size() - e.off; }
+
+    struct Cold { std::string_view value; CellIR refs; };  // value: in the mapping
+    MappedFile map;
+    BankcHeader h{};
+    const BankcEntry* dir = nullptr;
+    std::string_view heap;
+    std::map<std::pair<long long, long long>, Cold> cells;
+    unsigned cellsStamp = 0;
+};
+
+// Text bank -> files/<ctx>.bankc, stamped with the text file it came from.
+inline bool compileBankFile(const Config& cfg, long long bankId, string& err){
+    fs::path src = contextFileName(cfg, bankId);
+    FileStamp st;
+    if (!statFile(src, st)) { err = "missing context file: " + src.string(); return false; }
+    Bank b;
+    if (!loadContextFile(cfg, src, b, err)) return false;
+    return writeCompiledBank(cfg, b, st, compiledFileName(cfg, bankId), err);
+}
+
+// "current", "stale" or "missing" for the .bankc of a bank.
+inline string compiledBankStatus(const Config& cfg, long long bankId){
+    CompiledBank cb;
+    string err;
+    if (!fs::exists(compiledFileName(cfg, bankId)) || !cb.open(compiledFileName(cfg, bankId), err)) return "missing";
+    FileStamp st;
+    return statFile(contextFileName(cfg, bankId), st) && !cb.stale(cfg, st) ? "current" : "stale";
+}
+
+// The up-to-date .bankc of a bank that is not loaded, or nullptr. Opened once
+// per workspace; text-only banks are remembered as nullptr. What is
+// remembered holds until refreshColdBanks() sees either file change.
+inline CompiledBank* coldBank(const Config& cfg, Workspace& ws, long long bankId){
+    auto it = ws.compiled.find(bankId);
+    if (it == ws.compiled.end()){
+        ColdBank cold;
+        fs::path p = compiledFileName(cfg, bankId);
+        const bool text = statFile(contextFileName(cfg, bankId), cold.text);
+        (void)statFile(p, cold.compiled);
+        auto cb = std::make_shared<CompiledBank>();
+        string err;
+        if (text && fs::exists(p) && cb->open(p, err) && !cb->stale(cfg, cold.text)
+            && !(cfg.journal && openMatchingJournal(cfg, bankId, cold.text).size() > sizeof(WalHeader)))
+            cold.bank = std::move(cb);
+        it = ws.compiled.emplace(bankId, std::move(cold)).first;
+    }
+    return it->second.bank.get();
+}
+
+// Forgets what coldBank() found for unloaded banks whose text or .bankc has
+// changed on disk since, with the cached resolutions that read them. Views
+// from a CompiledBank die with it: call this between expansions only.
+inline void refreshColdBanks(const Config& cfg, Workspace& ws){
+    for (auto it = ws.compiled.begin(); it != ws.compiled.end(); ){
+        if (ws.banks.count(it->first)){ ++it; continue; }  // coldBank() is not asked
+        FileStamp text, compiled;
+        (void)statFile(contextFileName(cfg, it->first), text);
+        (void)statFile(compiledFileName(cfg, it->first), compiled);
+        if (text == it->second.text && compiled == it->second.compiled){ ++it; continue; }
+        ws.cache.invalidateBank(it->first, true);
+        it = ws.compiled.erase(it);
+    }
+}
+
+inline bool ensureBankLoadedInWorkspace(const Config& cfg, Workspace& ws, long long bankId, string& err){
+    if (ws.banks.count(bankId)) return true;
+    fs::path file = contextFileName(cfg, bankId);
+    if (!fs::exists(file)) { err = "missing context file: " + file.string(); return false; }
+    Bank b;
+    if (!loadContextFile(cfg, file, b, err)) return false;
+    replayJournal(cfg, bankId, b);
+    ws.banks[bankId] = std::move(b);
+    ws.filenames[bankId] = file.string();
+    ws.cache.invalidateBank(bankId, false);
+    indexBank(cfg, ws, bankId);
+    return true;
+}
+
+// ----------------------------- Include cache -----------------------------
+// Text of one @file(...) target with its references compiled (without
+// further @file). Shared: a Resolver frame holds it by pointer.
+struct IncludedFile {
+    FileStamp stamp;
+    unsigned irStampValue = 0;
+    string text;      // small files, or the [Missing file: ...] marker
+    MappedFile map;   // large files
+    std::string_view body;
+    CellIR refs;
+};
+
+// Process-wide cache of @file(...) targets keyed by path. An entry is
+// reused while the file's mtime, size and inode are unchanged, so a file
+// included from many cells is read once; files of kMapMin bytes or more
+// are mapped instead of copied.
+class IncludeCache {
+public:
+    static constexpr size_t kMapMin = 64 * 1024;
+
+    std::shared_ptr<const IncludedFile> get(const Config& cfg, const string& name){
+        fs::path p = fs::path("files") / name;
+        const string key = p.string();
+        FileStamp st;
+        if (!statFile(p, st)){
+            std::lock_guard<std::mutex> lk(m);
+            entries.erase(key);
+            return marker(cfg, fs::exists(p) ? "[Cannot open file: " + name + "]" : "[Missing file: " + name + "]");
+        }
+        {
+            std::lock_guard<std::mutex> lk(m);
+            auto it = entries.find(key);
+            if (it != entries.end() && it->second->stamp == st && it->second->irStampValue == irStamp(cfg))
+                return it->second;
+        }
+        auto inc = std::make_shared<IncludedFile>();
+        inc->stamp = st;
+        inc->irStampValue = irStamp(cfg);
+        string err;
+        if (st.size >= kMapMin){
+            if (!inc->map.open(p, err)) return marker(cfg, "[Cannot open file: " + name + "]");
+            inc->body = inc->map.view();
+        } else {
+            std::ifstream in(p, std::ios::binary);
+            if (!in) return marker(cfg, "[Cannot open file: " + name + "]");
+            inc->text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            inc->body = inc->text;
+        }
+        inc->refs = compileCell(inc->body, cfg, false);
+        std::lock_guard<std::mutex> lk(m);
+        entries[key] = inc;
+        return inc;
+    }
+    void clear(){
+        std::lock_guard<std::mutex> lk(m);
+        entries.clear();
+    }
+
+private:
+    static std::shared_ptr<const IncludedFile> marker(const Config& cfg, string text){
+        auto inc = std::make_shared<IncludedFile>();
+        inc->text = std::move(text);
+        inc->body = inc->text;
+        inc->refs = compileCell(inc->body, cfg, false);
+        return inc;
+    }
+    std::mutex m;
+    std::unordered_map<string, std::shared_ptr<const IncludedFile>> entries;
+};
+
+inline IncludeCache& includeCache(){
+    static IncludeCache cache;
+    return cache;
+}
+
+// ----------------------------- Resolver (both styles active) -----------------------------
+// Private state of one worker in a parallel resolve. The workspace is
+// read-only while workers run: new cache entries collect here for the caller
+// to merge, and a reference into a bank that is not loaded defers the cell
+// to a sequential pass instead of loading it.
+struct ResolveScratch {
+    const std::unordered_set<long long>* absent = nullptr;  // banks without a file
+    bool closed = false;  // every bank that can be loaded already is
+    std::unordered_map<CellKey, std::pair<string, std::vector<CellKey>>, CellKeyHash> added;
+    bool deferred = false;
+};
+
+struct Resolver {
+    const Config& cfg;
+    Workspace& ws;
+    ResolveScratch* scratch = nullptr;  // set for parallel workers
+    mutable bool coldChecked = false;   // see syncCache()
+    Resolver(const Config& c, Workspace& w): cfg(c), ws(w) {}
+
+    // Value and compiled references of a cell; loads the bank on demand and
+    // recompiles it if the Config changed since it was compiled. A bank that
+    // is not loaded but has a current .bankc is looked up there instead.
+    std::optional<std::string_view> getCell(long long bank, long long reg, long long addr, CellRefs& refs) const {
+        if (ws.cells.ready(cfg))
+            if (const CellIndex::Hit* h = ws.cells.find(bank, reg, addr)){
+                refs = h->refs;
+                return h->value->view();
+            }
+        if (scratch){
+            auto itB = ws.banks.find(bank);
+            if (itB==ws.banks.end() || itB->second.irStampValue != irStamp(cfg)){
+                if (itB!=ws.banks.end() || (!scratch->closed && (!scratch->absent || !scratch->absent->count(bank))))
+                    scratch->deferred = true;
+                return std::nullopt;
+            }
+            const CellValue* v = itB->second.find(reg, addr);
+            if (!v) return std::nullopt;
+            refs = itB->second.refs(reg, addr);
+            return v->view();
+        }
+        if (!ws.banks.count(bank))
+            if (CompiledBank* cb = coldBank(cfg, ws, bank)){
+                return cb->cell(cfg, reg, addr, refs);
+            }
+        string err;
+        (void)ensureBankLoadedInWorkspace(cfg, const_cast<Workspace&>(ws), bank, err);
+        auto itB = ws.banks.find(bank);
+        if (itB==ws.banks.end()) return std::nullopt;
+        auto& b = const_cast<Bank&>(itB->second);
+        if (b.irStampValue != irStamp(cfg)) b.compile(cfg);
+        const CellValue* v = b.find(reg, addr);
+        if (!v) return std::nullopt;
+        refs = b.refs(reg, addr);
+        return v->view();
+    }
+    bool getValue(long long bank, long long reg, long long addr, string& out) const {
+        CellRefs refs;
+        auto v = getCell(bank, reg, addr, refs);
+        if (!v) return false;
+        out = *v;
+        return true;
+    }
+    bool getValueTwoPart(long long bank, long long addr, string& out) const {
+        return getValue(bank, 1, addr, out);
+    }
+    string includeFile(const string& name) const {
+        return string(includeCache().get(cfg, name)->body);
+    }
+
+    // What an expansion touched: cells/keys it read and whether the result is
+    // context-free enough for ws.cache (see ResolveCache).
+    struct ExpandInfo {
+        bool cacheable = true;
+        std::vector<CellKey> deps;
+    };
+
+    // Cells under expansion from the outermost reference inwards; meeting one
+    // of them again is a circular reference. Shared by the whole walk, so each
+    // nesting level costs one push and one pop.
+    struct Path {
+        std::vector<CellKey> stack;
+        std::unordered_set<CellKey, CellKeyHash> on;
+        bool push(const CellKey& k){
+            if (!on.insert(k).second) return false;
+            stack.push_back(k);
+            return true;
+        }
+        void pop(){ on.erase(stack.back()); stack.pop_back(); }
+    };
+
+    string resolve(std::string_view input, long long currentBank) const {
+        Path path;
+        return expand(input, compileCell(input, cfg), currentBank, path);
+    }
+
+    // Resolved value of a stored cell, served from and added to ws.cache.
+    string resolveCell(long long bank, long long reg, long long addr,
+                       std::string_view val, CellRefs refs) const {
+        syncCache();
+        CellKey k{bank, reg, addr};
+        if (const string* hit = findCached(k)) return *hit;
+        Path path;
+        ExpandInfo info;
+        string out = expand(val, refs, bank, path, &info);
+        if (info.cacheable && out.size() <= ResolveCache::kMaxValue) putCached(k, out, std::move(info.deps));
+        return out;
+    }
+
+    // One text being expanded: the root, a referenced cell or an included file.
+    struct Frame {
+        Frame(std::string_view s, CellRefs r, long long b, size_t o): src(s), refs(r), bank(b), owner(o) {}
+        std::string_view src;
+        CellRefs refs;
+        long long bank;
+        size_t next = 0, last = 0;
+        size_t owner;           // frame whose ExpandInfo this one feeds
+        ExpandInfo info;        // used when owner is this frame
+        bool cell = false;      // a referenced cell: cache it when done
+        CellKey key{};
+        size_t outStart = 0;
+        std::shared_ptr<const IncludedFile> inc;
+    };
+
+    // Walks the compiled references of src, copying the literal gaps through.
+    // Included text is expanded for references but not for further @file(...).
+    // A reference to a cell on ws.cycles is circular at once; the path check
+    // catches loops the analysis has not seen (through included text, or
+    // with the analysis stale).
+    // Nested cells are entered on an explicit stack rather than by recursion,
+    // so chain length is bounded by memory, not the call stack; every frame
+    // appends to the one output buffer and a finished cell's value is the
+    // tail it produced.
+    string expand(std::string_view src, CellRefs refs, long long currentBank,
+                  Path& path, ExpandInfo* info = nullptr) const {
+        syncCache();
+        if (!scratch)
+            for (auto& [id, cold] : ws.compiled) if (cold.bank) cold.bank->trim();
+        string out; out.reserve(src.size());
+        static thread_local std::vector<Frame> stack;  // storage reused across calls
+        stack.clear();
+        stack.emplace_back(src, refs, currentBank, 0);
+
+        while (!stack.empty()){
+            Frame& f = stack.back();
+            const size_t self = stack.size() - 1;
+            ExpandInfo& in = stack[f.owner].info;
+            if (f.next == f.refs.size()){
+                out.append(f.src, f.last, string::npos);
+                if (self == 0){
+                    if (info) *info = std::move(f.info);
+                }
+                else if (f.cell){
+                    path.pop();
+                    // An uncached cell leaves its caller uncached too, since the
+                    // caller's entry would not record what the cell read.
+                    if (f.info.cacheable && out.size() - f.outStart <= ResolveCache::kMaxValue)
+                        putCached(f.key, out.substr(f.outStart), std::move(f.info.deps));
+                    else stack[stack[self-1].owner].info.cacheable = false;
+                }
+                stack.pop_back();
+                continue;
+            }
+            const RefToken& t = f.refs[f.next++];
+            out.append(f.src, f.last, t.off - f.last);
+            f.last = t.off + t.len;
+            std::string_view tok = f.src.substr(t.off, t.len);
+            switch (t.kind){
+            case RefToken::File: {
+                in.cacheable = false;
+                auto inc = includeCache().get(cfg, string(f.src.substr(t.nameOff, t.nameLen)));
+                std::string_view body = inc->body;
+                CellRefs bodyRefs = inc->refs;
+                const long long bank = f.bank;
+                const size_t owner = f.owner;
+                stack.emplace_back(body, bodyRefs, bank, owner);
+                stack.back().inc = std::move(inc);
+                break;
+            }
+            case RefToken::BadRef:
+                out += "[BadRef "; out += tok; out += "]";
+                break;
+            case RefToken::Missing:
+                out += "[Missing "; out += tok; out += "]";
+                break;
+            case RefToken::Three:
+            case RefToken::Two: {
+                CellKey k{t.bank, t.reg, t.addr};
+                if (path.on.count(k) || ws.cycles.onCycle(irStamp(cfg), k)) {
+                    in.cacheable = false;
+                    out += "[Circular Ref: "; out += tok; out += "]";
+                    break;
+                }
+                in.deps.push_back(k);
+                if (const string* hit = findCached(k)) { out += *hit; break; }
+                CellRefs subRefs;
+                auto v = getCell(t.bank, t.reg, t.addr, subRefs);
+                if (!v) {
+                    if (scratch && scratch->deferred) in.cacheable = false;
+                    out += "[Missing "; out += tok; out += "]";
+                    break;
+                }
+                path.push(k);
+                stack.emplace_back(*v, subRefs, t.bank, stack.size());
+                Frame& sub = stack.back();
+                sub.cell = true;
+                sub.key = k;
+                sub.outStart = out.size();
+                break;
+            }
+            }
+        }
+        return out;
+    }
+
+    const string* findCached(const CellKey& k) const {
+        if (const string* hit = ws.cache.find(k)) return hit;
+        if (!scratch) return nullptr;
+        auto it = scratch->added.find(k);
+        return it==scratch->added.end() ? nullptr : &it->second.first;
+    }
+    void putCached(const CellKey& k, string value, std::vector<CellKey> from) const {
+        if (scratch) scratch->added.emplace(k, std::make_pair(std::move(value), std::move(from)));
+        else ws.cache.put(k, std::move(value), std::move(from));
+    }
+
+    // Entries built under a different prefix/base are worthless. The first
+    // call also drops cold banks changed on disk (see refreshColdBanks), so
+    // a resolve started afterwards reads the files as they are now.
+    void syncCache() const {
+        if (scratch) return;
+        if (!coldChecked){ refreshColdBanks(cfg, ws); coldChecked = true; }
+        if (ws.cache.stamp == irStamp(cfg)) return;
+        ws.cache.clear();
+        ws.cache.stamp = irStamp(cfg);
+    }
+};
+
+// ----------------------------- Config file helpers -----------------------------
+inline void ensurePaths(const Paths& P){ P.ensure(); }
+inline Config loadConfig(const Paths& P){
+    ensurePaths(P);
+    Config cfg;
+    if (fs::exists(P.config)) {
+        std::ifstream in(P.config);
+        string j( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
+        cfg = Config::fromJSON(j);
+    } else {
+        std::ofstream out(P.config);
+        out << cfg.toJSON();
+    }
+    return cfg;
+}
+inline void saveConfig(const Paths& P, const Config& cfg){
+    std::ofstream out(P.config);
+    out << cfg.toJSON();
+}
+
+// ----------------------------- Utility ops used by CLI/GUI -----------------------------
+// Value storage of the loaded banks: `bytes` as the cells see them, `stored`
+// once per distinct block (interning shares equal values), and the chunk
+// bytes all arenas hold (ValueArena::reservedBytes).
+struct ValueStats {
+    size_t cells = 0, bytes = 0;
+    size_t distinct = 0, stored = 0;
+    size_t reserved = 0;
+    double dedup() const { return stored ? double(bytes) / double(stored) : 1.0; }
+};
+inline ValueStats valueStats(const Workspace& ws){
+    ValueStats st;
+    std::unordered_set<const char*> seen;
+    for (auto& [id, b] : ws.banks)
+        for (auto& [rid, addrs] : b.regs)
+            for (const auto& [aid, val] : addrs){
+                ++st.cells;
+                st.bytes += val.size();
+                if (!val.empty() && seen.insert(val.data()).second){ ++st.distinct; st.stored += val.size(); }
+            }
+    st.reserved = ValueArena::reservedBytes();
+    return st;
+}
+
+// --- openCtx: load-or-create without testing writability ------------------
+inline bool openCtx(const Config& cfg,
+                    Workspace& ws,
+                    std::string nameOrStem,
+                    std::string& status)
+{
+    // Normalize stem and compute id
+    std::string stem = nameOrStem;
+    if (stem.size() > 4 && stem.substr(stem.size() - 4) == ".txt")
+        stem.resize(stem.size() - 4);
+
+    std::string token = (!stem.empty() && stem[0] == cfg.prefix) ? stem.substr(1) : stem;
+    long long id = 0;
+    if (!parseIntBase(token, cfg.base, id)) {
+        status = "Bad context id: " + stem;
+        return false;
+    }
+
+    auto path = contextFileName(cfg, id);
+    Bank b;
+    if (auto it = ws.journals.find(id); it != ws.journals.end()) it->second->wait();
+
+    if (std::filesystem::exists(path)) {
+        // OPEN FOR READING ONLY — opening must NOT fail if file is read-only
+        FileStamp stamp;
+        const bool stamped = statFile(path, stamp);
+        MappedFile map;
+        string err;
+        if (!map.open(path, err)) { status = "Cannot open: " + path.string(); return false; }
+        const unsigned jobs = map.size() >= 4 * kParallelParseChunk ? defaultJobs() : 1;
+        auto pr = parseBankTextParallel(map.view(), cfg, b, jobs);
+        if (!pr.ok) { status = "Parse failed: " + pr.err; return false; }
+        if (stamped) b.layout = captureLayout(map.view(), stamp, b, cfg);
+        replayJournal(cfg, id, b);
+        if (b.title.empty()) b.title = stem;
+        unindexBank(ws, id);
+        ws.banks[id] = std::move(b);
+        ws.cache.invalidateBank(id, true);
+        indexBank(cfg, ws, id);
+        status = "Opened " + path.string();
+        return true;
+    }
+
+    // New (empty) bank if file doesn't exist
+    b.title = stem;
+    replayJournal(cfg, id, b);
+    unindexBank(ws, id);
+    ws.banks[id] = std::move(b);
+    ws.cache.invalidateBank(id, true);
+    indexBank(cfg, ws, id);
+    status = "Created new context: " + path.string();
+    return true;
+}
+
+
+// Loads every bank reachable from bankId's cells through references,
+// including those in @file(...) included text, so that a resolve started
+// afterwards loads nothing (a load would make ws.cycles stale halfway
+// through) and a parallel pass finds them in memory. Returns the
+// referenced ids with no file.
+inline std::unordered_set<long long> loadReachableBanks(const Config& cfg, Workspace& ws, long long bankId){
+    std::unordered_set<long long> absent;
+    std::unordered_set<CellKey, CellKeyHash> seen;
+    std::vector<CellKey> work;
+    auto reach = [&](const RefToken& t){
+        if (t.kind!=RefToken::Three && t.kind!=RefToken::Two) return;
+        if (absent.count(t.bank)) return;
+        string err;
+        if (!ensureBankLoadedInWorkspace(cfg, ws, t.bank, err)) { absent.insert(t.bank); return; }
+        auto& b = ws.banks[t.bank];
+        if (b.irStampValue != irStamp(cfg)) b.compile(cfg);
+        CellKey next{t.bank, t.reg, t.addr};
+        if (b.find(t.reg, t.addr) && seen.insert(next).second) work.push_back(next);
+    };
+    auto& b0 = ws.banks[bankId];
+    if (b0.irStampValue != irStamp(cfg)) b0.compile(cfg);
+    for (const auto& [ra, ir] : b0.ir) work.push_back({bankId, ra.first, ra.second});
+    while (!work.empty()){
+        CellKey k = work.back(); work.pop_back();
+        const Bank& bk = ws.banks[k.bank];
+        const CellValue* v = bk.find(k.reg, k.addr);
+        if (!v) continue;
+        const std::string_view src = v->view();
+        for (auto& t : bk.refs(k.reg, k.addr)){
+            if (t.kind != RefToken::File){ reach(t); continue; }
+            auto inc = includeCache().get(cfg, string(src.substr(t.nameOff, t.nameLen)));
+            for (auto& u : inc->refs) reach(u);
+        }
+    }
+    return absent;
+}
+
+// Resolved values of every cell of a bank, in regs iteration order. With
+// jobs>1 the cells are cut into address ranges and resolved on a
+// work-stealing pool; results are identical to the sequential path.
+inline std::vector<string> resolveBankCells(const Config& cfg, Workspace& ws, long long bankId, unsigned jobs = 1){
+    Resolver R(cfg, ws);
+    auto& b = ws.banks[bankId];
+    if (b.irStampValue != irStamp(cfg)) b.compile(cfg);
+    struct Item { long long reg, addr; std::string_view val; };
+    std::vector<Item> items;
+    for (auto& [rid, addrs] : b.regs)
+        for (const auto& [aid, val] : addrs) items.push_back({rid, aid, val});
+    std::vector<string> out(items.size());
+
+    // Everything reachable is loaded first, so the cycle analysis covers it
+    // and no bank turns up halfway through.
+    auto absent = loadReachableBanks(cfg, ws, bankId);
+    analyzeCycles(cfg, ws);
+    R.syncCache();
+    const size_t chunk = std::max<size_t>(64, items.size() / (size_t(jobs) * 8 + 1));
+    if (jobs <= 1 || items.size() <= chunk){
+        for (size_t i=0; i<items.size(); ++i)
+            out[i] = R.resolveCell(bankId, items[i].reg, items[i].addr, items[i].val, b.refs(items[i].reg, items[i].addr));
+        return out;
+    }
+
+    const size_t nChunks = (items.size() + chunk - 1) / chunk;
+    std::vector<ResolveScratch> scratch(nChunks);
+    std::vector<std::vector<size_t>> deferred(nChunks);
+    {
+        WorkStealingPool pool(jobs);
+        for (size_t c=0; c<nChunks; ++c){
+            pool.submit([&, c]{
+                Resolver W(cfg, ws);
+                W.scratch = &scratch[c];
+                scratch[c].absent = &absent;
+                for (size_t i=c*chunk; i<std::min(items.size(), (c+1)*chunk); ++i){
+                    scratch[c].deferred = false;
+                    const Item& it = items[i];
+                    out[i] = W.resolveCell(bankId, it.reg, it.addr, it.val, b.refs(it.reg, it.addr));
+                    if (scratch[c].deferred) deferred[c].push_back(i);
+                }
+            });
+        }
+        pool.wait();
+    }
+    for (auto& sc : scratch)
+        for (auto& [k, entry] : sc.added)
+            if (!ws.cache.find(k)) ws.cache.put(k, std::move(entry.first), std::move(entry.second));
+    for (auto& list : deferred)
+        for (size_t i : list)
+            out[i] = R.resolveCell(bankId, items[i].reg, items[i].addr, items[i].val, b.refs(items[i].reg, items[i].addr));
+    return out;
+}
+
+// Writes a resolved bank as text or JSON one cell at a time, registers and
+// addresses in ascending order. regLines is whether the text form names its
+// registers (it does when there is more than one).
+class ResolvedWriter {
+public:
+    ResolvedWriter(std::ostream& os, const Config& cfg, bool json, long long bankId, std::string_view title, bool regLines)
+        : os(os), cfg(cfg), json(json), regLines(regLines) {
+        if (json){
+            os << "{\n";
+            os << "  \"bank\": \""<< cfg.prefix<<toBaseN(bankId,cfg.base,cfg.widthBank) <<"\",\n";
+            os << "  \"title\": \""<< title <<"\",\n";
+            os << "  \"registers\": [\n";
+        }
+        else os << cfg.prefix << toBaseN(bankId, cfg.base, cfg.widthBank) << "\t(" << title << "){\n";
+    }
+    void beginRegister(long long reg){
+        if (json){
+            closeRegister();
+            if (!firstR) os << ",\n";
+            firstR = false;
+            os << "    {\"id\":\""<<toBaseN(reg,cfg.base,cfg.widthReg)<<"\",\"addresses\":[\n";
+            open = true; firstA = true;
+        }
+        else if (regLines) os << toBaseN(reg, cfg.base, cfg.widthReg) << "\n";
+    }
+    void cell(long long addr, std::string_view value){
+        if (!json){
+            os << "\t" << toBaseN(addr, cfg.base, cfg.widthAddr) << "\t" << value << "\n";
+            return;
+        }
+        if (!firstA) os << ",\n";
+        firstA = false;
+        os << "      {\"id\":\""<<toBaseN(addr,cfg.base,cfg.widthAddr)<<"\",\"value\":\"";
+        size_t from = 0;
+        for (size_t i = 0; i < value.size(); ++i){
+            const char c = value[i];
+            if (c!='\\' && c!='"' && c!='\n') continue;
+            os.write(value.data()+from, std::streamsize(i-from));
+            if (c=='\n') os << "\\n";
+            else { os.put('\\'); os.put(c); }
+            from = i+1;
+        }
+        os.write(value.data()+from, std::streamsize(value.size()-from));
+        os << "\"}";
+    }
+    void finish(){
+        if (json){ closeRegister(); os << "\n  ]\n}\n"; }
+        else os << "}\n";
+    }
+
+private:
+    void closeRegister(){ if (open) os << "\n    ]}"; open = false; }
+    std::ostream& os;
+    const Config& cfg;
+    bool json, regLines;
+    bool firstR = true, firstA = true, open = false;
+};
+
+// Text and JSON renderings of a bank given its resolved values in regs order.
+inline string formatResolved(const Config& cfg, const Bank& b, const std::vector<string>& resolved, bool json){
+    std::ostringstream os;
+    ResolvedWriter w(os, cfg, json, b.id, b.title, b.regs.size()>1);
+    size_t i = 0;
+    for (auto& [rid, addrs] : b.regs){
+        w.beginRegister(rid);
+        for (const auto& [aid, val] : addrs) w.cell(aid, resolved[i++]);
+    }
+    w.finish();
+    return os.str();
+}
+inline string formatResolvedText(const Config& cfg, const Bank& b, const std::vector<string>& resolved){
+    return formatResolved(cfg, b, resolved, false);
+}
+inline string formatResolvedJSON(const Config& cfg, const Bank& b, const std::vector<string>& resolved){
+    return formatResolved(cfg, b, resolved, true);
+}
+
+inline string resolveBankToText(const Config& cfg, Workspace& ws, long long bankId, unsigned jobs = 1){
+    auto resolved = resolveBankCells(cfg, ws, bankId, jobs);
+    return formatResolvedText(cfg, ws.banks[bankId], resolved);
+}
+
+inline string exportBankToJSON(const Config& cfg, Workspace& ws, long long bankId, unsigned jobs = 1){
+    auto resolved = resolveBankCells(cfg, ws, bankId, jobs);
+    return formatResolvedJSON(cfg, ws.banks[bankId], resolved);
+}
+
+// Resolves a bank file record by record and writes it to out, for banks too
+// large to load. One pass checks the cells are in ascending order without
+// repeats (as writeBankText leaves them) and counts registers, a second
+// resolves and writes. References into the bank itself are served from its
+// .bankc when that is current, otherwise the bank is loaded after all, so
+// compile very large banks first. There is no cycle analysis up front; the
+// path check still catches every loop.
+inline bool streamResolveBankFile(const Config& cfg, Workspace& ws, const fs::path& src,
+                                  std::ostream& out, bool json, string& err){
+    BankStream::Record r;
+    size_t regs = 0;
+    {
+        BankStream in(src, cfg);
+        bool first = true;
+        long long lastReg = 0, lastAddr = 0;
+        while (in.next(r)){
+            if (!first && (r.reg < lastReg || (r.reg == lastReg && r.addr <= lastAddr))){
+                err = "cells out of order; export it without --stream";
+                return false;
+            }
+            if (first || r.reg != lastReg) ++regs;
+            first = false; lastReg = r.reg; lastAddr = r.addr;
+        }
+        if (!in.result().ok){ err = in.result().err; return false; }
+    }
+
+    constexpr size_t kCacheCells = 1 << 16;  // ws.cache is cleared past this
+    BankStream in(src, cfg);
+    if (!in.ok()){ err = in.result().err; return false; }
+    Resolver R(cfg, ws);
+    ResolvedWriter w(out, cfg, json, in.id(), in.title(), regs>1);
+    bool first = true;
+    long long lastReg = 0;
+    while (in.next(r)){
+        if (first || r.reg != lastReg) w.beginRegister(r.reg);
+        first = false; lastReg = r.reg;
+        if (ws.cache.values.size() > kCacheCells) ws.cache.clear();
+        w.cell(r.addr, R.resolveCell(in.id(), r.reg, r.addr, r.value, compileCell(r.value, cfg)));
+    }
+    if (!in.result().ok){ err = in.result().err; return false; }
+    w.finish();
+    if (!out){ err = "write failed"; return false; }
+    return true;
+}
+
+// Ids of the bank files in files/, in directory order.
+inline std::vector<long long> bankIdsOnDisk(const Config& cfg){
+    std::vector<long long> ids;
+    for (auto& entry : fs::directory_iterator("files")){
+        if (!entry.is_regular_file()) continue;
         auto p = entry.path();
         if (p.extension() != ".txt") continue;
         string stem = p.stem().string();
         if (stem.empty() || stem[0]!=cfg.prefix) continue;
         long long id;
         if (!parseIntBase(stem.substr(1), cfg.base, id)) continue;
-        string err; (void)ensureBankLoadedInWorkspace(cfg, ws, id, err);
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+inline void preloadAll(const Config& cfg, Workspace& ws, bool frozen = false){
+    for (long long id : bankIdsOnDisk(cfg)){
+        string err;
+        if (ensureBankLoadedInWorkspace(cfg, ws, id, err) && frozen) freezeBank(cfg, ws, id);
+    }
+}
+
+// Throughput of each supported scan kernel over one bank text: the bare line
+// scan, and parseBankText as a whole. Best of reps runs; the kernel in use
+// is restored afterwards.
+struct ScanBench { ScanKernel kernel; double scanGBs = 0, parseGBs = 0; };
+
+inline std::vector<ScanBench> benchScanKernels(std::string_view text, const Config& cfg, int reps = 5){
+    using Clock = std::chrono::steady_clock;
+    const FindEitherFn saved = findEitherSlot().load();
+    auto gbs = [&](double s){ return s > 0 ? double(text.size()) / s / 1e9 : 0.0; };
+    std::vector<ScanBench> out;
+    for (ScanKernel k : {ScanKernel::Scalar, ScanKernel::SSE2, ScanKernel::AVX2}){
+        if (!scanKernelSupported(k)) continue;
+        useScanKernel(k);
+        double scan = 1e30, parse = 1e30;
+        volatile size_t sink = 0;
+        for (int r = 0; r < reps; ++r){
+            auto t0 = Clock::now();
+            size_t lines = 0;
+            for (size_t i = 0; i < text.size(); ++lines)
+                i += findEither(text.data() + i, text.size() - i, '\n', '}') + 1;
+            sink = sink + lines;
+            auto t1 = Clock::now();
+            Bank b;
+            (void)parseBankText(text, cfg, b);
+            auto t2 = Clock::now();
+            scan  = std::min(scan,  std::chrono::duration<double>(t1 - t0).count());
+            parse = std::min(parse, std::chrono::duration<double>(t2 - t1).count());
+        }
+        out.push_back({k, gbs(scan), gbs(parse)});
+    }
+    findEitherSlot().store(saved);
+    return out;
+}
+
+// ----------------------------- Whole-workspace export pipeline -----------------------------
+// Fixed-capacity FIFO between two pipeline stages. push blocks while full,
+// pop blocks while empty and returns false once closed and drained.
+template<class T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity): cap(std::max<size_t>(1, capacity)) {}
+    void push(T v){
+        std::unique_lock<std::mutex> lk(m);
+        notFull.wait(lk, [&]{ return q.size() < cap; });
+        q.push_back(std::move(v));
+        notEmpty.notify_one();
+    }
+    bool pop(T& out){
+        std::unique_lock<std::mutex> lk(m);
+        notEmpty.wait(lk, [&]{ return !q.empty() || closedFlag; });
+        if (q.empty()) return false;
+        out = std::move(q.front()); q.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+    void close(){
+        std::lock_guard<std::mutex> lk(m);
+        closedFlag = true;
+        notEmpty.notify_all();
+    }
+private:
+    std::mutex m;
+    std::condition_variable notEmpty, notFull;
+    std::deque<T> q;
+    size_t cap;
+    bool closedFlag = false;
+};
+
+// A group of threads running the same stage body; the output queue is
+// closed when the last of them returns.
+class StageThreads {
+public:
+    template<class Fn>
+    StageThreads(unsigned n, Fn body, std::function<void()> onDone): left(std::max(1u, n)), done(std::move(onDone)) {
+        for (unsigned i=0; i<std::max(1u, n); ++i)
+            threads.emplace_back([this, body]{ body(); if (--left == 0 && done) done(); });
+    }
+    ~StageThreads(){ join(); }
+    void join(){ for (auto& t : threads) if (t.joinable()) t.join(); }
+private:
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> left;
+    std::function<void()> done;
+};
+
+struct PipelineReport {
+    size_t banks = 0;
+    size_t written = 0;
+    std::vector<string> errors;
+};
+
+// Resolves every loaded or on-disk bank to files/out/ as .resolved.txt
+// (json=false) or .json. Stages: read -> parse -> (insert) -> resolve ->
+// serialize -> write, joined by bounded queues. Reading and parsing overlap
+// each other; the workspace is filled before resolving starts, since
+// resolution follows references into any bank. Resolution, formatting and
+// writing then overlap, with the workspace read-only.
+inline PipelineReport exportAllBanks(const Config& cfg, Workspace& ws, bool json, unsigned jobs = 1){
+    PipelineReport rep;
+    jobs = std::max(1u, jobs);
+    const size_t depth = size_t(jobs) * 4;
+    std::mutex errM;
+    auto fail = [&](string e){ std::lock_guard<std::mutex> lk(errM); rep.errors.push_back(std::move(e)); };
+
+    // read -> parse -> insert
+    std::vector<long long> toRead;
+    for (long long id : bankIdsOnDisk(cfg)) if (!ws.banks.count(id)) toRead.push_back(id);
+    // Files are mapped, not read into memory.
+    struct Raw { long long id; fs::path file; MappedFile map; FileStamp stamp; bool stamped; };
+    struct Parsed { long long id; fs::path file; Bank bank; };
+    {
+        BoundedQueue<Raw> raw(depth);
+        BoundedQueue<Parsed> parsed(depth);
+        StageThreads readers(1, [&]{
+            for (long long id : toRead){
+                Raw r{id, contextFileName(cfg, id), {}, {}, false};
+                r.stamped = statFile(r.file, r.stamp);
+                string err;
+                if (!r.map.open(r.file, err)){ fail(err); continue; }
+                raw.push(std::move(r));
+            }
+        }, [&]{ raw.close(); });
+        StageThreads parsers(jobs, [&]{
+            Raw r;
+            while (raw.pop(r)){
+                Parsed p{r.id, std::move(r.file), Bank{}};
+                ParseResult pr = parseBankText(r.map.view(), cfg, p.bank);
+                if (!pr.ok){ fail(p.file.string() + ": " + pr.err); continue; }
+                if (r.stamped) p.bank.layout = captureLayout(r.map.view(), r.stamp, p.bank, cfg);
+                r.map.reset();
+                replayJournal(cfg, p.id, p.bank);
+                parsed.push(std::move(p));
+            }
+        }, [&]{ parsed.close(); });
+        Parsed p;
+        while (parsed.pop(p)){
+            if (ws.banks.count(p.id)) continue;
+            ws.banks[p.id] = std::move(p.bank);
+            ws.filenames[p.id] = p.file.string();
+            ws.cache.invalidateBank(p.id, false);
+            indexBank(cfg, ws, p.id);
+        }
+    }
+
+    // resolve -> serialize -> write
+    std::vector<long long> ids;
+    for (auto& [id, b] : ws.banks){
+        if (b.irStampValue != irStamp(cfg)) b.compile(cfg);
+        ids.push_back(id);
+    }
+    rep.banks = ids.size();
+    analyzeCycles(cfg, ws);
+    Resolver(cfg, ws).syncCache();
+    std::error_code ec;
+    fs::create_directories("files/out", ec);
+
+    struct Resolved { long long id; std::vector<string> values; };
+    struct Text { fs::path out; string body; };
+    std::atomic<size_t> next{0};
+    std::vector<ResolveScratch> scratch(jobs);
+    std::atomic<unsigned> worker{0};
+    std::atomic<size_t> written{0};
+    {
+        BoundedQueue<Resolved> resolved(depth);
+        BoundedQueue<Text> texts(depth);
+        StageThreads resolvers(jobs, [&]{
+            ResolveScratch& sc = scratch[worker++];
+            sc.closed = true;
+            Resolver W(cfg, ws);
+            W.scratch = &sc;
+            for (size_t i = next++; i < ids.size(); i = next++){
+                const Bank& b = ws.banks.find(ids[i])->second;
+                Resolved r{ids[i], {}};
+                for (auto& [rid, addrs] : b.regs)
+                    for (const auto& [aid, val] : addrs)
+                        r.values.push_back(W.resolveCell(ids[i], rid, aid, val, b.refs(rid, aid)));
+                sc.added.clear();  // r.values has the results; keep one bank's worth at most
+                resolved.push(std::move(r));
+            }
+        }, [&]{ resolved.close(); });
+        StageThreads formatters(std::max(1u, jobs / 2), [&]{
+            Resolved r;
+            while (resolved.pop(r)){
+                const Bank& b = ws.banks.find(r.id)->second;
+                if (json) texts.push({outJsonName(cfg, r.id), formatResolvedJSON(cfg, b, r.values)});
+                else      texts.push({outResolvedName(cfg, r.id), formatResolvedText(cfg, b, r.values)});
+            }
+        }, [&]{ texts.close(); });
+        StageThreads writers(1, [&]{
+            Text t;
+            while (texts.pop(t)){
+                std::ofstream out(t.out, std::ios::binary | std::ios::trunc);
+                out.write(t.body.data(), (std::streamsize)t.body.size());
+                if (!out) fail("write failed: " + t.out.string());
+                else ++written;
+            }
+        }, {});
     }
+    rep.written = written;
+    return rep;
 }
 
 } // namespace scripted
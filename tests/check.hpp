@@ -0,0 +1,38 @@
+// Shared by the tests: CHECK reports a failed condition and carries on;
+// main() returns report(). Each test runs in its own working directory
+// (see CMakeLists.txt) and starts from an empty files/.
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+namespace scripted_test {
+
+inline int& failures(){ static int n = 0; return n; }
+
+inline void check(bool ok, const char* what, const char* file, int line){
+    if (ok) return;
+    ++failures();
+    std::cerr << file << ":" << line << ": CHECK failed: " << what << "\n";
+}
+
+inline int report(){
+    if (failures()) std::cerr << failures() << " check(s) failed\n";
+    return failures() ? 1 : 0;
+}
+
+inline void freshFiles(){
+    std::filesystem::remove_all("files");
+    std::filesystem::create_directories("files/out");
+}
+
+inline std::string slurp(const std::filesystem::path& p){
+    std::ifstream in(p, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace scripted_test
+
+#define CHECK(cond) ::scripted_test::check(bool(cond), #cond, __FILE__, __LINE__)
@@ -0,0 +1,123 @@
+// AddrTable against std::map through its sparse, dense and frozen forms.
+#include "scripted_core.hpp"
+#include "check.hpp"
+#include <limits>
+#include <map>
+#include <random>
+
+using namespace scripted;
+
+static bool sameAs(const AddrTable& t, const std::map<long long, string>& m){
+    if (t.size() != m.size()) return false;
+    auto it = m.begin();
+    for (const auto& [a, v] : t){
+        if (it == m.end() || it->first != a || it->second != v.view()) return false;
+        ++it;
+    }
+    return it == m.end();
+}
+
+static void randomOps(){
+    std::mt19937_64 rng(7);
+    size_t denseSeen = 0, sparseSeen = 0, frozenSeen = 0;
+    for (int round = 0; round < 60; ++round){
+        AddrTable t;
+        ValueArena arena;
+        std::map<long long, string> m;
+        const long long range = round % 4 == 0 ? 200000 : 1 + (long long)(rng() % 5000);
+        for (int i = 0; i < 5000; ++i){
+            long long a = (long long)(rng() % range) - range / 3;
+            if (round % 10 == 3 && rng() % 4 == 0)
+                a = rng() % 2 ? std::numeric_limits<long long>::min() + (long long)(rng() % 4)
+                              : std::numeric_limits<long long>::max() - (long long)(rng() % 4);
+            const unsigned k = rng() % 10;
+            if (k < 5){
+                string v = rng() % 7 == 0 ? string() : std::to_string(rng() % 1000);
+                t.set(a, CellValue(arena, v));
+                m[a] = v;
+            }
+            else if (k < 6 && !m.empty() && m.rbegin()->first < std::numeric_limits<long long>::max() - 4){
+                const long long b = m.rbegin()->first + 1 + (long long)(rng() % 3);  // appends go dense
+                t.set(b, CellValue(arena, "x"));
+                m[b] = "x";
+            }
+            else if (k < 9) CHECK(t.erase(a) == (m.erase(a) == 1));
+            else {
+                const CellValue* p = t.find(a);
+                auto it = m.find(a);
+                CHECK((p != nullptr) == (it != m.end()));
+                if (p && it != m.end()) CHECK(p->view() == it->second);
+            }
+            if (rng() % 1500 == 0){ t.freeze(); CHECK(sameAs(t, m)); }
+            if (t.frozen()) ++frozenSeen;
+            else if (t.isDense()) ++denseSeen;
+            else ++sparseSeen;
+        }
+        CHECK(sameAs(t, m));
+    }
+    CHECK(denseSeen > 0);
+    CHECK(sparseSeen > 0);
+    CHECK(frozenSeen > 0);
+}
+
+static void denseThresholds(){
+    ValueArena arena;
+    AddrTable t;
+    for (int i = 0; i < 10000; ++i) t.set(i, CellValue(arena, "v"));
+    CHECK(t.isDense());
+    for (int i = 0; i < 10000; i += 2) t.erase(i);  // half full: still dense
+    CHECK(t.isDense());
+    for (int i = 1; i < 10000; i += 4) t.erase(i);
+    t.erase(3);                                     // under a quarter: sparse
+    CHECK(!t.isDense());
+
+    AddrTable spread;
+    for (int i = 0; i < 1000; ++i) spread.set(i * 10, CellValue(arena, "v"));
+    CHECK(!spread.isDense());
+}
+
+static void frozenForm(){
+    ValueArena arena;
+    AddrTable t;
+    std::map<long long, string> m;
+    for (long long a = -500; a < 50000; a += 7){
+        t.set(a, CellValue(arena, std::to_string(a)));
+        m[a] = std::to_string(a);
+    }
+    t.freeze();
+    CHECK(t.frozen());
+    CHECK(sameAs(t, m));
+    for (long long a = -600; a < 50100; ++a){
+        const CellValue* p = t.find(a);
+        CHECK((p != nullptr) == (m.count(a) == 1));
+    }
+    // Edits thaw it back.
+    t.set(3, CellValue(arena, "three"));
+    m[3] = "three";
+    CHECK(!t.frozen());
+    CHECK(t.erase(-500));
+    m.erase(-500);
+    CHECK(sameAs(t, m));
+
+    // A frozen bank reads the same and thaws on edit.
+    Config cfg;
+    Bank b;
+    b.irStampValue = irStamp(cfg);
+    for (int r = 1; r <= 3; ++r)
+        for (int a = 0; a < 2000; ++a) b.set(r, a * (r == 2 ? 9 : 1), "v x00001.01.0002 " + std::to_string(a), cfg);
+    Bank before = b;
+    b.freeze();
+    CHECK(b.frozen());
+    CHECK(b.regs == before.regs);
+    CHECK(b.refs(1, 5).size() == before.refs(1, 5).size());
+    b.set(1, 5, "plain", cfg);
+    CHECK(!b.frozen());
+    CHECK(b.refs(1, 5).empty());
+}
+
+int main(){
+    randomOps();
+    denseThresholds();
+    frozenForm();
+    return scripted_test::report();
+}
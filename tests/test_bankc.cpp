@@ -0,0 +1,135 @@
+// .bankc: what writeCompiledBank writes reads back the same, goes stale with
+// its text, and damaged files are refused rather than read past.
+#include "scripted_core.hpp"
+#include "check.hpp"
+
+using namespace scripted;
+
+static Bank sample(const Config& cfg){
+    Bank b;
+    b.id = 3;
+    b.title = "Compiled title";
+    b.irStampValue = irStamp(cfg);
+    for (int r = 1; r <= 3; ++r)
+        for (int a = 0; a < 3000; ++a)
+            b.set(r, a * r, "val " + std::to_string(a) + string(a % 50, 'z') + " x00003.01.0003", cfg);
+    b.set(4, 0, "", cfg);
+    return b;
+}
+
+static void roundTrip(){
+    Config cfg;
+    const Bank b = sample(cfg);
+    const fs::path p = "files/rt.bankc";
+    string err;
+    CHECK(writeCompiledBank(cfg, b, FileStamp{1, 2, 3}, p, err));
+
+    CompiledBank cb;
+    CHECK(cb.open(p, err));
+    CHECK(cb.id() == 3);
+    CHECK(cb.title() == "Compiled title");
+    CHECK(cb.size() == 9001);
+    CHECK(!cb.stale(cfg, FileStamp{1, 2, 3}));
+    CHECK(cb.stale(cfg, FileStamp{1, 2, 4}));
+    Config other = cfg;
+    other.base = 16;
+    CHECK(cb.stale(other, FileStamp{1, 2, 3}));
+
+    Bank back;
+    cb.toBank(cfg, back);
+    CHECK(back.title == b.title);
+    CHECK(back.regs == b.regs);
+    for (const auto& [r, addrs] : b.regs)
+        for (const auto& [a, v] : addrs){
+            auto f = cb.find(r, a);
+            CHECK(f && *f == v.view());
+            CellRefs refs;
+            auto c = cb.cell(cfg, r, a, refs);
+            CHECK(c && *c == v.view());
+            CHECK(refs.size() == b.refs(r, a).size());
+        }
+    CHECK(!cb.find(1, 1000000));
+    CHECK(!cb.find(9, 0));
+    cb.trim();
+}
+
+// compileBankFile stamps the text; rewriting the text makes it stale.
+static void status(){
+    Config cfg;
+    Bank b = sample(cfg);
+    string err;
+    CHECK(compiledBankStatus(cfg, 3) == "missing");
+    CHECK(saveContextFile(cfg, contextFileName(cfg, 3), b, err));
+    CHECK(compileBankFile(cfg, 3, err));
+    CHECK(compiledBankStatus(cfg, 3) == "current");
+    b.set(1, 1, "changed", cfg);
+    CHECK(saveContextFile(cfg, contextFileName(cfg, 3), b, err));
+    CHECK(compiledBankStatus(cfg, 3) == "stale");
+}
+
+static void damaged(){
+    Config cfg;
+    string err;
+    const fs::path p = "files/bad.bankc";
+    CHECK(writeCompiledBank(cfg, sample(cfg), FileStamp{}, p, err));
+    const string good = scripted_test::slurp(p);
+    auto put = [&](const string& bytes){ std::ofstream(p, std::ios::binary | std::ios::trunc) << bytes; };
+
+    CompiledBank cb;
+    put(good.substr(0, sizeof(BankcHeader) - 1));
+    CHECK(!cb.open(p, err));
+    put(good.substr(0, sizeof(BankcHeader) + 100 * sizeof(BankcEntry)));
+    CHECK(!cb.open(p, err));
+
+    BankcHeader h;
+    std::memcpy(&h, good.data(), sizeof h);
+    h.titleOff = ~0ull - 2;
+    string bad = good;
+    std::memcpy(bad.data(), &h, sizeof h);
+    put(bad);
+    CompiledBank title;
+    CHECK(!title.open(p, err));
+
+    bad = good;
+    bad[0] = 'Q';
+    put(bad);
+    CompiledBank magic;
+    CHECK(!magic.open(p, err));
+}
+
+// Cold lookups follow the files: a resolve after the text was rewritten and
+// recompiled, or only rewritten, reads the new value.
+static void cold(){
+    Config cfg;
+    string err;
+    Bank b;
+    b.id = 5;
+    b.irStampValue = irStamp(cfg);
+    b.set(1, 1, "old", cfg);
+    CHECK(saveContextFile(cfg, contextFileName(cfg, 5), b, err));
+    CHECK(compileBankFile(cfg, 5, err));
+
+    Workspace ws;
+    CHECK(Resolver(cfg, ws).resolve("x00005.0001", 1) == "old");
+    CHECK(!ws.banks.count(5) && ws.compiled[5].bank);
+
+    b.set(1, 1, "new", cfg);
+    CHECK(saveContextFile(cfg, contextFileName(cfg, 5), b, err));
+    CHECK(compileBankFile(cfg, 5, err));
+    CHECK(Resolver(cfg, ws).resolve("x00005.0001", 1) == "new");
+    CHECK(!ws.banks.count(5));
+
+    b.set(1, 1, "text only", cfg);
+    CHECK(saveContextFile(cfg, contextFileName(cfg, 5), b, err));
+    CHECK(Resolver(cfg, ws).resolve("x00005.0001", 1) == "text only");
+    CHECK(ws.banks.count(5));
+}
+
+int main(){
+    scripted_test::freshFiles();
+    roundTrip();
+    status();
+    damaged();
+    cold();
+    return scripted_test::report();
+}
@@ -0,0 +1,159 @@
+// The edit journal: edits come back on reopen, a torn append loses only
+// itself, and compaction folds the journal into the text file every time it
+// fills, not only the first.
+#include "scripted_core.hpp"
+#include "check.hpp"
+#include <chrono>
+
+using namespace scripted;
+
+// Records for setCells from a vector.
+struct Cells {
+    using Record = BankStream::Record;
+    std::vector<std::pair<long long, string>> cells;  // addr, value; register 1
+    size_t i = 0;
+    bool next(Record& r){
+        if (i == cells.size()) return false;
+        r = {1, cells[i].first, cells[i].second};
+        ++i;
+        return true;
+    }
+};
+
+static Config journaled(){
+    Config cfg;
+    cfg.journal = true;
+    return cfg;
+}
+
+static void replay(){
+    scripted_test::freshFiles();
+    const Config cfg = journaled();
+    string err, status;
+    {
+        Workspace ws;
+        CHECK(openCtx(cfg, ws, "x00001", status));
+        CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+        bool logged = false;
+        setCell(cfg, ws, 1, 1, 1, "one", &logged);
+        CHECK(logged);
+        setCell(cfg, ws, 1, 2, 5, "five x00001.01.0001", &logged);
+        CHECK(logged);
+        setCell(cfg, ws, 1, 1, 2, "two", &logged);
+        CHECK(eraseCell(cfg, ws, 1, 1, 2, &logged));
+        CHECK(logged);
+        setCell(cfg, ws, 1, 1, 3, "last", &logged);
+        CHECK(ws.journals[1]->pending() > 0);
+    }
+    {
+        Workspace ws;
+        CHECK(openCtx(cfg, ws, "x00001", status));
+        const Bank& b = ws.banks[1];
+        CHECK(b.find(1, 1) && b.find(1, 1)->view() == "one");
+        CHECK(b.find(2, 5) && b.find(2, 5)->view() == "five x00001.01.0001");
+        CHECK(!b.find(1, 2));
+        CHECK(b.find(1, 3) && b.find(1, 3)->view() == "last");
+    }
+    {
+        // With the journal off it is not read.
+        Workspace ws;
+        CHECK(openCtx(Config{}, ws, "x00001", status));
+        CHECK(!ws.banks[1].find(1, 1));
+    }
+    {
+        // A torn last append: the records before it still replay.
+        fs::resize_file(journalFileName(cfg, 1), fs::file_size(journalFileName(cfg, 1)) - 3);
+        Workspace ws;
+        CHECK(openCtx(cfg, ws, "x00001", status));
+        CHECK(ws.banks[1].find(1, 1) && !ws.banks[1].find(1, 3));
+        // Appends go after the intact records.
+        setCell(cfg, ws, 1, 1, 4, "after the tear");
+        ws.journals.clear();
+        Workspace again;
+        CHECK(openCtx(cfg, again, "x00001", status));
+        CHECK(again.banks[1].find(1, 4) && again.banks[1].find(1, 1));
+    }
+}
+
+static bool drained(Journal& j){
+    for (int i = 0; i < 3000 && j.pending() != 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return j.pending() == 0;
+}
+
+static void compaction(){
+    scripted_test::freshFiles();
+    const Config cfg = journaled();
+    string err, status;
+    Workspace ws;
+    CHECK(openCtx(cfg, ws, "x00001", status));
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+
+    const size_t n = Journal::kCompactBytes / 4096 + 16;
+    for (int round = 0; round < 2; ++round){
+        Cells in;
+        for (size_t a = 0; a < n; ++a)
+            in.cells.push_back({(long long)(round * n + a), string(4096, char('a' + round))});
+        CHECK(setCells(cfg, ws, 1, in));
+        // The first compaction is left to finish on its own, so the second
+        // has to start over a finished worker that was never joined.
+        CHECK(drained(*ws.journals[1]));
+    }
+    ws.journals[1]->wait();
+
+    // Both rounds are in the text file itself.
+    Workspace plain;
+    CHECK(openCtx(Config{}, plain, "x00001", status));
+    CHECK(plain.banks[1].regs == ws.banks[1].regs);
+    CHECK(plain.banks[1].regs[1].size() == 2 * n);
+
+    setCell(cfg, ws, 1, 1, 0, "saved");
+    CHECK(ws.journals[1]->pending() > 0);
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+    CHECK(ws.journals[1]->pending() == 0);
+    CHECK(fs::file_size(journalFileName(cfg, 1)) == sizeof(WalHeader));
+}
+
+// The new journal cannot replace the old one after a save: the journal
+// closes rather than append over a file that no longer matches the text,
+// and the next save starts it over.
+static void renameFails(){
+    scripted_test::freshFiles();
+    const Config cfg = journaled();
+    const fs::path wal = journalFileName(cfg, 1);
+    string err, status;
+    Workspace ws;
+    CHECK(openCtx(cfg, ws, "x00001", status));
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+    bool logged = false;
+    setCell(cfg, ws, 1, 1, 1, "before", &logged);
+    CHECK(logged);
+
+    fs::remove(wal);
+    fs::create_directories(wal / "blocked");  // a file cannot be renamed over it
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+    setCell(cfg, ws, 1, 1, 2, "unjournaled", &logged);
+    CHECK(!logged);
+    CHECK(fs::is_directory(wal / "blocked"));
+
+    fs::remove_all(wal);
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+    setCell(cfg, ws, 1, 1, 3, "journaled again", &logged);
+    CHECK(logged);
+    CHECK(ws.journals[1]->pending() > 0);
+    ws.journals.clear();
+
+    Workspace again;
+    CHECK(openCtx(cfg, again, "x00001", status));
+    const Bank& b = again.banks[1];
+    CHECK(b.find(1, 1) && b.find(1, 1)->view() == "before");
+    CHECK(b.find(1, 2) && b.find(1, 2)->view() == "unjournaled");
+    CHECK(b.find(1, 3) && b.find(1, 3)->view() == "journaled again");
+}
+
+int main(){
+    replay();
+    compaction();
+    renameFails();
+    return scripted_test::report();
+}
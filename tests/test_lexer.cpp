@@ -0,0 +1,129 @@
+// scanRefs and compileCell: which form wins where they overlap, the malformed
+// cases, other bases, and values far longer than the regexes could take.
+#include "scripted_core.hpp"
+#include "check.hpp"
+
+using namespace scripted;
+
+// "F:name", "3:a.b.c" or "2:p:a.b" per match, with its position.
+static std::vector<string> scan(std::string_view s, bool allowFile = true){
+    std::vector<string> out;
+    scanRefs(s, allowFile, [&](const RefSpan& m){
+        string t = std::to_string(m.pos) + "+" + std::to_string(m.len) + " ";
+        switch (m.kind){
+        case RefSpan::File:  t += "F:"; t += m.a; break;
+        case RefSpan::Three: t += "3:"; t += m.a; t += '.'; t += m.b; t += '.'; t += m.c; break;
+        case RefSpan::Two:   t += "2:"; t += m.prefix; t += ':'; t += m.a; t += '.'; t += m.b; break;
+        }
+        out.push_back(t);
+    });
+    return out;
+}
+using V = std::vector<string>;
+
+static void precedence(){
+    CHECK(scan("@file(a.txt)") == V{"0+12 F:a.txt"});
+    CHECK(scan("@file(1.2.3)") == V{"0+12 F:1.2.3"});            // the include takes its name whole
+    CHECK(scan("@file(x00001.0002)") == V{"0+18 F:x00001.0002"});
+    CHECK(scan("1.2.3") == V{"0+5 3:1.2.3"});
+    CHECK(scan("x00001.0002") == V{"0+11 2:x:00001.0002"});
+    CHECK(scan("x1.2.3") == V{"1+5 3:1.2.3"});                   // b.r.a inside a two-part candidate wins
+    CHECK(scan("ab12.3.4") == V{"2+6 3:12.3.4"});
+    CHECK(scan("xA1.B2 1.2") == V{"0+6 2:x:A1.B2"});              // 1.2 is neither form
+    CHECK(scan("a x00002.01.0003 b") == V{"3+13 3:00002.01.0003"});
+    CHECK(scan("12.34.56.78") == V{"0+8 3:12.34.56"});
+    const V mixed{"4+12 F:i.txt", "23+11 2:x:00001.0002", "39+5 3:4.5.6"};
+    CHECK(scan("see @file(i.txt), then x00001.0002 and 4.5.6") == mixed);
+}
+
+static void malformed(){
+    CHECK(scan("@file(abc").empty());
+    CHECK(scan("@file(abc x00001.0002") == V{"10+11 2:x:00001.0002"});
+    CHECK(scan("@file()").empty());
+    CHECK(scan("@file(a) @file(").size() == 1);
+    CHECK(scan("@file(a.txt)", false).empty());
+    CHECK(scan("@file(1.2.3)", false) == V{"6+5 3:1.2.3"});
+    CHECK(scan("x.0002 x0001. .1.2 1..2.3 1.2.").empty());
+    CHECK(scan("").empty());
+    CHECK(scan("@").empty());
+    CHECK(scan("x").empty());
+}
+
+static RefToken only(std::string_view value, const Config& cfg){
+    CellIR ir = compileCell(value, cfg);
+    CHECK(ir.size() == 1);
+    return ir.empty() ? RefToken{} : ir[0];
+}
+
+static void bases(){
+    Config cfg;
+    RefToken t = only("x00001.0002", cfg);
+    CHECK(t.kind == RefToken::Two && t.bank == 1 && t.reg == 1 && t.addr == 2);
+    CHECK(only("x0000a.0001", cfg).kind == RefToken::BadRef);    // not base 10
+    CHECK(compileCell("y00001.0002", cfg).empty());               // someone else's prefix
+    CHECK(only("99999999999999999999.1.1", cfg).kind == RefToken::Missing);
+    t = only("9223372036854775807.0.1", cfg);
+    CHECK(t.kind == RefToken::Three && t.bank == std::numeric_limits<long long>::max());
+
+    Config hex = cfg;
+    hex.base = 16;
+    t = only("x0000a.00fF", hex);
+    CHECK(t.kind == RefToken::Two && t.bank == 10 && t.addr == 255);
+    Config b36 = cfg;
+    b36.base = 36;
+    b36.prefix = 'k';
+    t = only("kZZ.z", b36);
+    CHECK(t.kind == RefToken::Two && t.bank == 36 * 36 - 1 && t.addr == 35);
+    Config b2 = cfg;
+    b2.base = 2;
+    CHECK(only("x101.1", b2).addr == 1);
+    CHECK(only("x102.1", b2).kind == RefToken::BadRef);
+
+    // Widths pad what is written; any width is read back.
+    CHECK(toBaseN(7, 10, 4) == "0007");
+    CHECK(toBaseN(123456, 10, 4) == "123456");
+    CHECK(toBaseN(0, 16, 1) == "0");
+    long long v = 0;
+    CHECK(parseIntBase(toBaseN(1295, 36, 5), 36, v) && v == 1295);
+    CHECK(parseIntBase(toBaseN(std::numeric_limits<long long>::max(), 16, 2), 16, v)
+          && v == std::numeric_limits<long long>::max());
+    CHECK(only("x1.2", cfg).addr == 2);
+    CHECK(only("x000000000001.000000000002", cfg).bank == 1);
+}
+
+// A value of several MiB with many references: the regexes this replaced
+// ran out of stack on values like these.
+static void longValue(){
+    Config cfg;
+    string v;
+    for (int i = 0; i < 200000; ++i) v += "x00001.0002 1.1.3 ";
+    CHECK(scan(v).size() == 400000);
+    CHECK(compileCell(v, cfg).size() == 400000);
+
+    string digits(8 << 20, '7');
+    CHECK(scan(digits).empty());
+    string dots;
+    for (int i = 0; i < 1000000; ++i) dots += "1.";
+    CHECK(scan(dots).size() == 333333);
+    string open = "@file(" + string(8 << 20, 'n');
+    CHECK(scan(open).empty());
+    string alnum = "x" + string(8 << 20, 'a') + ".1";
+    CHECK(scan(alnum).size() == 1);
+
+    Workspace ws;
+    ws.banks[1].irStampValue = irStamp(cfg);
+    setCell(cfg, ws, 1, 1, 2, "two");
+    setCell(cfg, ws, 1, 1, 3, "three");
+    string want;
+    for (int i = 0; i < 200000; ++i) want += "two three ";
+    CHECK(Resolver(cfg, ws).resolve(v, 1) == want);
+}
+
+int main(){
+    scripted_test::freshFiles();
+    precedence();
+    malformed();
+    bases();
+    longValue();
+    return scripted_test::report();
+}
@@ -0,0 +1,69 @@
+// parseBankTextParallel gives what parseBankText gives, on text big enough
+// to be cut into several kParallelParseChunk pieces.
+#include "scripted_core.hpp"
+#include "check.hpp"
+#include <random>
+
+using namespace scripted;
+
+static string bigBank(const string& eol, std::mt19937& rng){
+    static const char* values[] = {"v", "x00001.0002", "a x00002.01.0003 b", "@file(inc.txt)", "", "x00003.02", "{ open"};
+    string s = "x00001 (Title){" + eol;
+    long long reg = 1;
+    while (s.size() < 3 * kParallelParseChunk){
+        s += toBaseN(reg++, 10, 2) + eol;
+        const int cells = 1 + int(rng() % 3000);
+        for (int a = 0; a < cells; ++a){
+            s += '\t';
+            s += toBaseN((long long)a * (1 + (long long)(rng() % 3)), 10, 4);
+            s += '\t';
+            s += values[rng() % 7];
+            s += eol;
+        }
+    }
+    // Register 1 again, in the last chunk: these cells replace earlier ones.
+    s += "01" + eol;
+    for (int a = 0; a < 100; ++a){
+        s += '\t';
+        s += toBaseN(a, 10, 4);
+        s += "\tagain";
+        s += eol;
+    }
+    return s + "}" + eol;
+}
+
+static void same(const string& text, const char* what){
+    Config cfg;
+    Bank seq;
+    const ParseResult a = parseBankText(text, cfg, seq);
+    for (unsigned jobs : {2u, 4u, 8u}){
+        Bank par;
+        const ParseResult b = parseBankTextParallel(text, cfg, par, jobs);
+        CHECK(a.ok == b.ok);
+        CHECK(a.err == b.err);
+        if (!a.ok || !b.ok) continue;
+        CHECK(seq.id == par.id);
+        CHECK(seq.title == par.title);
+        CHECK(seq.regs == par.regs);
+        CHECK(seq.ir.size() == par.ir.size());
+        CHECK(seq.valueBytes == par.valueBytes);
+        for (const auto& [k, refs] : seq.ir) CHECK(par.ir.find(k.first, k.second).size() == refs.size());
+    }
+    if (scripted_test::failures()) std::cerr << "  in " << what << "\n";
+}
+
+int main(){
+    std::mt19937 rng(1);
+    const string lf = bigBank("\n", rng);
+    same(lf, "LF text");
+    same(bigBank("\r\n", rng), "CRLF text");
+
+    // A bad line deep in the text fails both the same way.
+    string bad = lf;
+    const size_t at = bad.find('\n', bad.size() / 2 + 1) + 1;
+    bad.insert(at, "\tzz\tnot an address\n");
+    same(bad, "text with a bad address");
+    Bank b;
+    CHECK(!parseBankTextParallel(bad, Config{}, b, 4).ok);
+    return scripted_test::report();
+}
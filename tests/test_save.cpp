@@ -0,0 +1,64 @@
+// Incremental saves: a big bank opened through openCtx keeps its layout, and
+// saving it after edits writes what a full save would.
+#include "scripted_core.hpp"
+#include "check.hpp"
+
+using namespace scripted;
+
+static void fill(const Config& cfg, Bank& b){
+    b.id = 1;
+    b.title = "Big";
+    b.irStampValue = irStamp(cfg);
+    for (int r = 1; r <= 4; ++r)
+        for (int a = 0; a < 15000; ++a)
+            b.set(r, a, "value " + std::to_string(a * r) + (a % 7 ? "" : " x00001.02.0003"), cfg);
+}
+
+int main(){
+    scripted_test::freshFiles();
+    Config cfg;
+    const fs::path path = contextFileName(cfg, 1);
+    string err, status;
+    {
+        Bank b;
+        fill(cfg, b);
+        CHECK(saveContextFile(cfg, path, b, err));
+    }
+    CHECK(fs::file_size(path) >= kLayoutMinSize);
+
+    Workspace ws;
+    CHECK(openCtx(cfg, ws, "x00001", status));
+    CHECK(ws.banks[1].layout != nullptr);
+
+    // Nothing changed: nothing is written.
+    FileStamp before, after;
+    CHECK(statFile(path, before));
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+    CHECK(statFile(path, after));
+    CHECK(before == after);
+
+    // Edits in two registers, one erased cell, one new register.
+    setCell(cfg, ws, 1, 2, 17, "edited x00001.04.0001");
+    setCell(cfg, ws, 1, 2, 20000, "appended");
+    CHECK(eraseCell(cfg, ws, 1, 3, 100));
+    setCell(cfg, ws, 1, 7, 1, "new register");
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+    const string saved = scripted_test::slurp(path);
+    CHECK(saved == writeBankText(ws.banks[1], cfg));
+    CHECK(ws.banks[1].layout != nullptr);
+
+    // A second incremental save, over the layout the first one left.
+    CHECK(eraseCell(cfg, ws, 1, 1, 0));
+    setCell(cfg, ws, 1, 4, 5, "again");
+    CHECK(saveWorkspaceBank(cfg, ws, 1, err));
+    CHECK(scripted_test::slurp(path) == writeBankText(ws.banks[1], cfg));
+
+    // What was saved loads back as the same cells.
+    Workspace other;
+    CHECK(openCtx(cfg, other, "x00001", status));
+    CHECK(other.banks[1].title == ws.banks[1].title);
+    CHECK(other.banks[1].regs == ws.banks[1].regs);
+    CHECK(other.banks[1].find(7, 1) && other.banks[1].find(7, 1)->view() == "new register");
+    CHECK(!other.banks[1].find(3, 100));
+    return scripted_test::report();
+}
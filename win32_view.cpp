@@ -124,11 +124,13 @@ public:
     void showRows(const std::vector<Row>& rowsIn) override {
         rows = rowsIn; // already filtered by Presenter
         ListView_DeleteAllItems(hList);
+        auto regs  = formatIdColumn(rows, [](const Row& r){ return r.reg; },  cfg.base, cfg.widthReg);
+        auto addrs = formatIdColumn(rows, [](const Row& r){ return r.addr; }, cfg.base, cfg.widthAddr);
         for (int i=0;i<(int)rows.size();++i){
             const Row& r = rows[i];
             LVITEMW it{}; it.mask = LVIF_TEXT; it.iItem = i;
-            std::wstring regW  = s2ws(toBaseN(r.reg,  cfg.base, cfg.widthReg));
-            std::wstring addrW = s2ws(toBaseN(r.addr, cfg.base, cfg.widthAddr));
+            std::wstring regW (regs[i].begin(),  regs[i].end());   // ids are ASCII
+            std::wstring addrW(addrs[i].begin(), addrs[i].end());
             std::wstring valW  = s2ws(r.val);
             it.pszText = regW.data();
             ListView_InsertItem(hList, &it);